@@ -0,0 +1,129 @@
+// md-parser/allocationhook.cpp - heap allocation hook for --mem-stats
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "allocationhook.hpp"
+
+#include <cstddef>
+#include "mdparser.h"
+
+#if defined(__GLIBC__)
+
+#include <atomic>
+#include <cerrno>
+#include <malloc.h>
+
+
+// glibc lets a program replace malloc and friends and still reach its own
+// allocator through the __libc_ entry points.
+extern "C" {
+  void* __libc_malloc(size_t size);
+  void* __libc_calloc(size_t count, size_t size);
+  void* __libc_realloc(void* pointer, size_t size);
+  void __libc_free(void* pointer);
+  void* __libc_memalign(size_t alignment, size_t size);
+  void* __libc_valloc(size_t size);
+  void* __libc_pvalloc(size_t size);
+}
+
+namespace {
+  std::atomic<bool> counting{false};
+
+  inline bool isCounting() {
+    return counting.load(std::memory_order_relaxed);
+  }
+
+  inline void* counted(void* pointer) {
+    if (pointer && isCounting()) mdparser_count_allocation(malloc_usable_size(pointer));
+
+    return pointer;
+  }
+}
+
+extern "C" {
+  void* malloc(size_t size) {
+    return counted(__libc_malloc(size));
+  }
+
+  void* calloc(size_t count, size_t size) {
+    return counted(__libc_calloc(count, size));
+  }
+
+  void* realloc(void* pointer, size_t size) {
+    bool counts{isCounting()};
+    size_t oldSize{counts && pointer ? malloc_usable_size(pointer) : 0};
+    void* newPointer{__libc_realloc(pointer, size)};
+
+    if (counts && (newPointer || size == 0)) {
+      if (pointer) mdparser_count_deallocation(oldSize);
+
+      if (newPointer) mdparser_count_allocation(malloc_usable_size(newPointer));
+    }
+
+    return newPointer;
+  }
+
+  // The aligned allocators are hooked too, as free() counts what they return.
+  void* memalign(size_t alignment, size_t size) {
+    return counted(__libc_memalign(alignment, size));
+  }
+
+  void* aligned_alloc(size_t alignment, size_t size) {
+    return counted(__libc_memalign(alignment, size));
+  }
+
+  int posix_memalign(void** pointer, size_t alignment, size_t size) {
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+
+    void* newPointer{counted(__libc_memalign(alignment, size))};
+
+    if (!newPointer) return ENOMEM;
+
+    *pointer = newPointer;
+
+    return 0;
+  }
+
+  void* valloc(size_t size) {
+    return counted(__libc_valloc(size));
+  }
+
+  void* pvalloc(size_t size) {
+    return counted(__libc_pvalloc(size));
+  }
+
+  void free(void* pointer) {
+    if (pointer && isCounting()) mdparser_count_deallocation(malloc_usable_size(pointer));
+
+    __libc_free(pointer);
+  }
+}
+
+bool enableAllocationHook() {
+  counting.store(true);
+
+  return true;
+}
+
+#else
+
+bool enableAllocationHook() {
+  return false;
+}
+
+#endif
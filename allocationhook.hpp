@@ -0,0 +1,26 @@
+// md-parser/allocationhook.hpp - heap allocation hook for --mem-stats
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+
+// Starts reporting malloc, calloc, realloc, the aligned allocators and free to
+// mdparser_count_allocation() and mdparser_count_deallocation().  Returns false
+// if malloc cannot be hooked on this platform.
+bool enableAllocationHook();
@@ -21,12 +21,17 @@
 
 #include "containerblock.hpp"
 #include "leafblock.hpp"
+#include "memstats.hpp"
+#include "parser.hpp"
 
 
 Block::Block(ContainerBlock* parent)
   : parent_(parent),
-    writable_(true)
-{}
+    writable_(true),
+    firstLine_(parent && parent->parser() ? parent->parser()->lineNumber() : 0)
+{
+  MemoryStats::countBlock();
+}
 
 Block::~Block() {}
 
@@ -38,10 +43,18 @@ int Block::baseIndent() const {
   return 0;
 }
 
+const QList<Block*> Block::children() const {
+  return QList<Block*>();
+}
+
 bool Block::appendFencedCodeText(const LineHandler& /* lineHandler */) {
   return false;
 }
 
+void Block::appendHTML(QString* output) const {
+  output->append(html());
+}
+
 bool Block::appendHTMLBlockText(const LineHandler& /* lineHandler */) {
   return false;
 }
@@ -50,6 +63,16 @@ void Block::appendLine(const LineHandler& /* lineHandler */) {
   return; // do nothing
 }
 
+// Appends the headings in the block, for Parser::getOutline()
+void Block::appendOutline(QVector<OutlineItem>* /* outline */) const {
+  return; // no heading
+}
+
+// Appends the text of the block without markup, for Parser::getPlainText()
+void Block::appendPlainText(QString* /* output */) const {
+  return; // no text
+}
+
 bool Block::isFencedCodeBlock() const {
   return false;
 }
@@ -58,6 +81,22 @@ bool Block::isParagraph() const {
   return false;
 }
 
+// Returns the number of the last line of the block
+int Block::lastLine() const {
+  return firstLine_;
+}
+
+// Returns the text of a leaf block as it is in the source, before inline parsing
+QString Block::literal() const {
+  return QString();
+}
+
+// Returns the position in the input of each character of literal() and of its
+// end, none for a container block
+QVector<int> Block::sourcePositions() const {
+  return QVector<int>();
+}
+
 bool Block::toggleFencedCodeBlock(QChar fenceChar, int count, const LineHandler& /* rest */, int indent) {
   parent()->appendLeafBlock(new FencedCodeBlock(parent(), fenceChar, count, "", indent));
   return true;
@@ -90,6 +129,14 @@ const ContainerBlock* Block::parent() const {
 void Block::disable() {
   writable_ = false;
 }
+
+int Block::firstLine() const {
+  return firstLine_;
+}
+
+void Block::setFirstLine(int line) {
+  firstLine_ = line;
+}
   
 bool Block::writable() const {
   return writable_;
@@ -19,15 +19,38 @@
 
 #pragma once
 
+#include <QList>
 #include <QString>
+#include <QVector>
 
 class ContainerBlock;
 class HeadingBlock;
 class LineHandler;
 
+// A heading of Parser::getOutline()
+struct OutlineItem {
+  int level;
+  QString html;  // the inline HTML of the text
+  int line;      // the number of the line where the heading starts
+};
 
 class Block {
 public:
+  // The kinds of blocks, as BlockEventReader reports them
+  enum Type {
+    Document,
+    BlockQuote,
+    BulletList,
+    OrderedList,
+    Item,
+    Paragraph,
+    Heading,
+    IndentedCode,
+    FencedCode,
+    HTML,
+    Break
+  };
+
   Block() = delete;
   Block(ContainerBlock* parent);
   Block(const Block& other) = delete;
@@ -35,27 +58,39 @@ public:
   virtual ~Block();
 
   virtual bool appendFencedCodeText(const LineHandler& lineHandler);
+  virtual void appendHTML(QString* output) const;
   virtual bool appendHTMLBlockText(const LineHandler& lineHandler);
   virtual void appendLine(const LineHandler& lineHandler);
+  virtual void appendOutline(QVector<OutlineItem>* outline) const;
+  virtual void appendPlainText(QString* output) const;
   virtual bool appendIndentedText(LineHandler* lineHandler) = 0;
   virtual bool appendParagraphText(const LineHandler& lineHandler) = 0;
   virtual int baseIndent() const;
+  virtual const QList<Block*> children() const;
   virtual void close();
   virtual bool closeHTMLBlock(const LineHandler& lineHandler);
   virtual HeadingBlock* convertToSetextHeading(const LineHandler& lineHandler);
+  virtual int estimateHTMLSize() const = 0;
   virtual QString fence() const;
   virtual void handleBlankLine(const LineHandler& lineHandler);
   virtual QString html() const = 0;
   virtual bool isFencedCodeBlock() const;
   virtual bool isParagraph() const;
+  virtual int lastLine() const;
+  virtual QString literal() const;
+  virtual QVector<int> sourcePositions() const;
   virtual bool toggleFencedCodeBlock(QChar fenceChar, int count, const LineHandler& rest, int indent);
+  virtual Type type() const = 0;
 
   void disable();
+  int firstLine() const;
   ContainerBlock* parent();
   const ContainerBlock* parent() const;
+  void setFirstLine(int line);
   bool writable() const;
 
 private:
   ContainerBlock* parent_;
   bool writable_;
+  int firstLine_; // the number of the line where the block started
 };
@@ -0,0 +1,160 @@
+// md-parser/blockeventreader.cpp - a pull reader of the blocks of a document
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "blockeventreader.hpp"
+
+#include "memstats.hpp"
+
+
+BlockEventReader::BlockEventReader(const QString& mdText)
+  : mdText_(mdText),
+    lines_(mdText_),
+    parser_(),
+    root_(),
+    nextLine_(0),
+    readBlocks_(0),
+    definitionsRead_(false),
+    events_(),
+    nextEvent_(0),
+    event_{NoEvent, nullptr, 0}
+{
+  parser_.beginDocument(&root_);
+}
+
+BlockEventReader::~BlockEventReader() {
+}
+
+bool BlockEventReader::atEnd() const {
+  return event_.type == EndDocument;
+}
+
+// Returns the type of the block which the current event belongs to
+Block::Type BlockEventReader::blockType() const {
+  return event_.block ? event_.block->type() : Block::Document;
+}
+
+// Returns the number of the blocks containing the block of the current event,
+// 0 for top-level blocks
+int BlockEventReader::depth() const {
+  return event_.depth;
+}
+
+BlockEventReader::EventType BlockEventReader::eventType() const {
+  return event_.type;
+}
+
+// Returns the inline elements of the text of a paragraph or a heading, with
+// their positions in the document.  As links may be defined anywhere, the lines
+// up to the last possible link reference definition are parsed first.
+QVector<InlineEvent> BlockEventReader::readInlineEvents() {
+  if (event_.type != Text ||
+      (event_.block->type() != Block::Paragraph && event_.block->type() != Block::Heading)) {
+    return QVector<InlineEvent>();
+  }
+
+  readDefinitions();
+  QVector<InlineEvent> events{InlineParser(event_.block->literal(), &parser_).textToEvents()};
+  const QVector<int> positions{event_.block->sourcePositions()};
+
+  for (InlineEvent& event : events) {
+    event.begin = positions.at(event.begin);
+    event.end = positions.at(event.end);
+  }
+
+  return events;
+}
+
+BlockEventReader::EventType BlockEventReader::readNext() {
+  if (atEnd()) return EndDocument;
+
+  if (nextEvent_ == events_.size()) {
+    events_.clear();
+    nextEvent_ = 0;
+
+    if (!readBlock()) {
+      event_ = Event{EndDocument, nullptr, 0};
+
+      return EndDocument;
+    }
+  }
+
+  event_ = events_.at(nextEvent_++);
+
+  return event_.type;
+}
+
+// Returns the source of the block which the current event belongs to
+SourceSpan BlockEventReader::span() const {
+  if (!event_.block) return SourceSpan{0, 0, 0, 0};
+
+  const int firstLine{event_.block->firstLine()};
+  const int lastLine{event_.block->lastLine()};
+  const QStringRef last{lines_.line(lastLine)};
+
+  return SourceSpan{firstLine, lastLine, lines_.line(firstLine).position(), last.position() + last.size()};
+}
+
+// Returns the text of a Text event, which is the source of a leaf block without
+// the markers of its containers and indentation
+QString BlockEventReader::text() const {
+  return event_.type == Text ? event_.block->literal() : QString();
+}
+
+// Parses lines until the next top-level block is closed, which is when another
+// one follows it or at the end of the document, and queues its events.
+// Returns false if no block is left.
+bool BlockEventReader::readBlock() {
+  MemoryPhase memoryPhase{MemoryStats::BlockParsing};
+
+  nextLine_ = parser_.parseBlocks(&root_, lines_, nextLine_, readBlocks_ + 1);
+
+  if (readBlocks_ == root_.childCount()) return false;
+
+  appendEvents(root_.children().at(readBlocks_++), 0);
+
+  return true;
+}
+
+// Parses lines until the block of the last line which may define a link is
+// closed, in the manner of Parser::getExcerpt()
+void BlockEventReader::readDefinitions() {
+  if (definitionsRead_) return;
+
+  MemoryPhase memoryPhase{MemoryStats::BlockParsing};
+  const int definitionLine{lines_.lastDefinitionLine()};
+  definitionsRead_ = true;
+
+  while (nextLine_ <= definitionLine) {
+    nextLine_ = parser_.parseBlocks(&root_, lines_, nextLine_, root_.childCount());
+  }
+
+  if (definitionLine >= 0) nextLine_ = parser_.parseBlocks(&root_, lines_, nextLine_, root_.childCount());
+}
+
+void BlockEventReader::appendEvents(const Block* block, int depth) {
+  events_.append(Event{StartBlock, block, depth});
+
+  if (!block->literal().isEmpty()) events_.append(Event{Text, block, depth});
+
+  for (const Block* child : block->children()) {
+    appendEvents(child, depth + 1);
+  }
+
+  events_.append(Event{EndBlock, block, depth});
+}
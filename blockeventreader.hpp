@@ -0,0 +1,92 @@
+// md-parser/blockeventreader.hpp - a pull reader of the blocks of a document
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include "block.hpp"
+#include "containerblock.hpp"
+#include "inlineparser.hpp"
+#include "lineindex.hpp"
+#include "parser.hpp"
+
+
+// The lines [firstLine, lastLine] of a block, and the characters [begin, end)
+// of the document they span
+struct SourceSpan {
+  int firstLine;
+  int lastLine;
+  int begin;
+  int end;
+};
+
+// Reads the blocks of a document as a stream of events, in the manner of
+// QXmlStreamReader.  Lines are parsed only as far as needed to close the next
+// top-level block, whose events are then returned one by one from readNext(),
+// so a reader can stop before the rest of the document is parsed.  The text of
+// a leaf block is its source before inline parsing, which readInlineEvents()
+// parses for a paragraph or a heading into elements with their positions in the
+// document.
+class BlockEventReader {
+public:
+  enum EventType {
+    NoEvent,
+    StartBlock,
+    EndBlock,
+    Text,
+    EndDocument
+  };
+
+  explicit BlockEventReader(const QString& mdText);
+  BlockEventReader(const BlockEventReader& other) = delete;
+  BlockEventReader& operator=(const BlockEventReader& other) = delete;
+  ~BlockEventReader();
+
+  bool atEnd() const;
+  Block::Type blockType() const;
+  int depth() const;
+  EventType eventType() const;
+  QVector<InlineEvent> readInlineEvents();
+  EventType readNext();
+  SourceSpan span() const;
+  QString text() const;
+
+private:
+  struct Event {
+    EventType type;
+    const Block* block;
+    int depth;
+  };
+
+  void appendEvents(const Block* block, int depth);
+  bool readBlock();
+  void readDefinitions();
+
+  const QString mdText_;
+  const LineIndex lines_;
+  Parser parser_;
+  BodyBlock root_;
+  int nextLine_;      // the first line not parsed yet
+  int readBlocks_;    // the top-level blocks whose events are queued
+  bool definitionsRead_;
+  QVector<Event> events_;
+  int nextEvent_;
+  Event event_;
+};
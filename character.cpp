@@ -21,34 +21,97 @@
 
 #include <algorithm>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MDPARSER_SSE2
+#endif
+
+
+namespace {
+  // ASCII punctuation characters, which can be backslash-escaped
+  constexpr bool isEscapable(QChar chr) {
+    return (chr >= '!' && chr <= '/') || (chr >= ':' && chr <= '@') ||
+      (chr >= '[' && chr <= '`') || (chr >= '{' && chr <= '~');
+  }
+
+  // Characters replaced by EntityChar
+  constexpr bool isEscaped(QChar chr) {
+    return chr == '"' || chr == '&' || chr == '<' || chr == '>';
+  }
+
+  // Reads hexadecimal digits as QString::toInt(&ok, 16) does, with an optional
+  // "0x" prefix.
+  bool toHex(const QStringRef& text, int* number) {
+    int pos{0};
+
+    if (text.length() > 2 && text.at(0) == '0' && (text.at(1) == 'x' || text.at(1) == 'X')) {
+      pos = 2;
+    }
+
+    if (pos == text.length()) return false;
+
+    long long value{0};
+
+    for (; pos < text.length(); ++pos) {
+      ushort chr{text.at(pos).unicode()};
+      int digit{chr >= '0' && chr <= '9' ? chr - '0' :
+	  chr >= 'a' && chr <= 'f' ? chr - 'a' + 10 :
+	  chr >= 'A' && chr <= 'F' ? chr - 'A' + 10 :
+	  -1};
+
+      if (digit < 0) return false;
+
+      value = value * 16 + digit;
+    }
+
+    if (value > 0x7fffffff) return false;
+
+    *number = static_cast<int>(value);
+
+    return true;
+  }
+}
+
 
 ///////////////////////
 // Escape characters //
 ///////////////////////
 
-EscapeChar::EscapeChar() : str_(), inputLength_(0) {}
+EscapeChar::EscapeChar() : str_(), chr_(), inputLength_(0) {}
 
 EscapeChar::EscapeChar(const QString& str, int inputLength)
   : str_(str),
+    chr_(),
     inputLength_(inputLength)
 {}
 
 EscapeChar::EscapeChar(QChar chr, int inputLength)
-  : str_(), inputLength_(inputLength)
+  : str_(), chr_(chr), inputLength_(inputLength)
 {
   if (chr == '"') {
-    str_.append("&quot;");
+    str_ = QStringLiteral("&quot;");
   } else if (chr == '<') {
-    str_.append("&lt;");
+    str_ = QStringLiteral("&lt;");
   } else if (chr == '>') {
-    str_.append("&gt;");
-  } else {
-    if (chr.unicodeVersion() == QChar::Unicode_Unassigned ||
-	chr.isNull()) {
-      chr = QChar(0xfffd);
-    }
+    str_ = QStringLiteral("&gt;");
+  } else if (chr.unicodeVersion() == QChar::Unicode_Unassigned ||
+	     chr.isNull()) {
+    chr_ = QChar(0xfffd);
+  }
+}
+
+// str is the HTML of chr
+EscapeChar::EscapeChar(const QString& str, QChar chr, int inputLength)
+  : str_(str),
+    chr_(chr),
+    inputLength_(inputLength)
+{}
 
-    str_.append(chr);
+void EscapeChar::appendTo(QString* text) const {
+  if (str_.isNull()) {
+    text->append(chr_);
+  } else {
+    text->append(str_);
   }
 }
 
@@ -61,7 +124,24 @@ int EscapeChar::inputLength() const {
 }
 
 QString EscapeChar::output() const {
-  return this->str_;
+  return str_.isNull() ? QString(chr_) : str_;
+}
+
+int EscapeChar::outputLength() const {
+  return str_.isNull() ? 1 : str_.length();
+}
+
+void EscapeChar::replace(QString* text, int pos) const {
+  if (str_.isNull()) {
+    text->replace(pos, inputLength_, chr_);
+  } else {
+    text->replace(pos, inputLength_, str_);
+  }
+}
+
+// Returns what the escape stands for, as plain text rather than HTML
+QString EscapeChar::text() const {
+  return chr_.isNull() ? str_ : QString(chr_);
 }
 
 EscapeChar EscapeChar::get(const QStringRef& text) {
@@ -86,67 +166,17 @@ EscapeChar EscapeChar::get(const QStringRef& text) {
 
 
 EscapeChar EscapeChar::getBackslashEscaped(const QStringRef& text) {
-  static const class BackslashEscapedList {
-  public:
-    BackslashEscapedList() {
-      EscapeChar backslashOnly{"\\", 1};
+  if (text.at(0) != '\\') return EscapeChar();
   
-      for (EscapeChar& ptr : list_) {
-	ptr = backslashOnly;
-      }
+  if (text.length() == 1) return EscapeChar(QStringLiteral("\\"), 1);
 
-      auto insert = [&](unsigned char chr, const char* str) {
-	list_[chr] = EscapeChar(str, 2);
-      };
-  
-      insert('\n', "<br />\n");
-      insert('!', "!");
-      insert('"', "&quot;");
-      insert('#', "#");
-      insert('$', "$");
-      insert('%', "%");
-      insert('&', "&amp;");
-      insert('\'', "'");
-      insert('(', "(");
-      insert(')', ")");
-      insert('*', "*");
-      insert('+', "+");
-      insert(',', ",");
-      insert('-', "-");
-      insert('.', ".");
-      insert('/', "/");
-      insert(':', ":");
-      insert(';', ";");
-      insert('<', "&lt;");
-      insert('=', "=");
-      insert('>', "&gt;");
-      insert('?', "?");
-      insert('@', "@");
-      insert('[', "[");
-      insert('\\', "\\");
-      insert(']', "]");
-      insert('^', "^");
-      insert('_', "_");
-      insert('`', "`");
-      insert('{', "{");
-      insert('|', "|");
-      insert('}', "}");
-      insert('~', "~");
-    }
+  QChar chr{text.at(1)};
 
-    EscapeChar operator[](QChar chr) const {
-      return list_[static_cast<unsigned char>(chr.toLatin1())];
-    }
+  if (chr == '\n') return EscapeChar(QStringLiteral("<br />\n"), chr, 2);
 
-    private:
-    EscapeChar list_[0xff];
-  } list;
-  
-  if (text.at(0) != '\\') return EscapeChar();
-  
-  if (text.length() == 1) return EscapeChar("\\", 1);
+  if (chr == '&') return EscapeChar(QStringLiteral("&amp;"), chr, 2);
 
-  return list[text.at(1)];
+  return isEscapable(chr) ? EscapeChar(chr, 2) : EscapeChar(QStringLiteral("\\"), 1);
 }
 
 EscapeChar EscapeChar::getEntityWithCode(const QStringRef& text) {
@@ -157,17 +187,20 @@ EscapeChar EscapeChar::getEntityWithCode(const QStringRef& text) {
     if (third == 'x' || third == 'X') return getEntityWithHex(text);
 
     if (third.isDigit()) {
-      int begin{3};
+      int begin{2};
       int end{std::min(text.length(), 11)}; // '&#' + 1-8 digits + ';"
-      QString decimal{third};
+      int number{0};
+      bool isASCII{true}; // other digits are not numbers for QString::toInt()
     
       for (int pos{begin}; pos < end; ++pos) {
 	QChar chr{text.at(pos)};
       
 	if (chr == ';') {
-	  return EscapeChar(QChar(decimal.toInt()), decimal.length() + 3);
+	  return EscapeChar(QChar(isASCII ? number : 0), pos + 1);
+	} else if (chr >= '0' && chr <= '9') {
+	  number = number * 10 + chr.unicode() - '0';
 	} else if (chr.isDigit()) {
-	  decimal.append(chr);
+	  isASCII = false;
 	} else {
 	  break;
 	}
@@ -181,21 +214,17 @@ EscapeChar EscapeChar::getEntityWithCode(const QStringRef& text) {
 EscapeChar EscapeChar::getEntityWithHex(const QStringRef& text) {
   int begin{3};
   int end{std::min(text.length(), 12)}; // '&#x' + 1-8 digits + ';"
-  QString hex{};
     
   for (int pos{begin}; pos < end; ++pos) {
     QChar chr{text.at(pos)};
       
     if (chr == ';') {
-      bool ok;
-      int number{hex.toInt(&ok, 16)};
+      int number;
 
-      if (!ok) break;
+      if (!toHex(text.mid(begin, pos - begin), &number)) break;
 	
-      return EscapeChar(QChar(number), hex.length() + 4);
-    } else if (chr.isLetterOrNumber()) {
-      hex.append(chr);
-    } else {
+      return EscapeChar(QChar(number), pos + 1);
+    } else if (!chr.isLetterOrNumber()) {
       break;
     }
   }
@@ -206,29 +235,32 @@ EscapeChar EscapeChar::getEntityWithHex(const QStringRef& text) {
 EscapeChar EscapeChar::getEntityWithText(const QStringRef& text) {
   int begin{1};
   int end{std::min(text.length(), 26)}; // max length of entity references (26)
-  QString temp{};
+  QChar name[26];
+  int length{0};
     
   for (int pos{begin}; pos < end; ++pos) {
     QChar chr{text.at(pos)};
       
     if (chr == ';') {
-      return temp == "nbsp" ? EscapeChar(QChar::Nbsp, 6) :
-	temp == "amp" ? EscapeChar("&amp;", 5) :
-	temp == "auml" ? EscapeChar("ä", 6) :
-	temp == "ouml" ? EscapeChar("ö", 6) :
-	temp == "copy" ? EscapeChar("©", 6) :
-	temp == "AElig" ? EscapeChar("Æ", 7) :
-	temp == "Dcaron" ? EscapeChar("Ď", 8) :
-	temp == "frac34" ? EscapeChar("¾", 8) :
-	temp == "HilbertSpace" ? EscapeChar("ℋ", 14) :
-	temp == "DifferentialD" ? EscapeChar("ⅆ", 15) :
-	temp == "ClockwiseContourIntegral" ? EscapeChar("∲", 26) :
-	temp == "ngE" ? EscapeChar("≧̸", 5) :
+      const QString temp{QString::fromRawData(name, length)};
+
+      return temp == QLatin1String("nbsp") ? EscapeChar(QChar::Nbsp, 6) :
+	temp == QLatin1String("amp") ? EscapeChar(QStringLiteral("&amp;"), QChar('&'), 5) :
+	temp == QLatin1String("auml") ? EscapeChar(QStringLiteral("ä"), 6) :
+	temp == QLatin1String("ouml") ? EscapeChar(QStringLiteral("ö"), 6) :
+	temp == QLatin1String("copy") ? EscapeChar(QStringLiteral("©"), 6) :
+	temp == QLatin1String("AElig") ? EscapeChar(QStringLiteral("Æ"), 7) :
+	temp == QLatin1String("Dcaron") ? EscapeChar(QStringLiteral("Ď"), 8) :
+	temp == QLatin1String("frac34") ? EscapeChar(QStringLiteral("¾"), 8) :
+	temp == QLatin1String("HilbertSpace") ? EscapeChar(QStringLiteral("ℋ"), 14) :
+	temp == QLatin1String("DifferentialD") ? EscapeChar(QStringLiteral("ⅆ"), 15) :
+	temp == QLatin1String("ClockwiseContourIntegral") ? EscapeChar(QStringLiteral("∲"), 26) :
+	temp == QLatin1String("ngE") ? EscapeChar(QStringLiteral("≧̸"), 5) :
 	EscapeChar();
     } else if (chr.isSpace()) {
       break;
     } else if (chr.isLetterOrNumber()) {
-      temp.append(chr);
+      name[length++] = chr;
     }
   }
 
@@ -251,10 +283,54 @@ QString EntityChar::output() const {
   return str_;
 }
 
+// Appends text with '"', '&', '<' and '>' replaced by their entity references.
+// The runs between them are copied at once; with SSE2 they are found eight
+// characters at a time.
+void EntityChar::appendEscaped(QString* output, const QStringRef& text) {
+  const QChar* data{text.unicode()};
+  const int length{text.length()};
+  int pos{0};
+
+  output->reserve(output->length() + length);
+
+  while (pos < length) {
+    int begin{pos};
+
+#ifdef MDPARSER_SSE2
+    const __m128i quot{_mm_set1_epi16('"')};
+    const __m128i amp{_mm_set1_epi16('&')};
+    const __m128i lt{_mm_set1_epi16('<')};
+    const __m128i gt{_mm_set1_epi16('>')};
+
+    for (; pos + 8 <= length; pos += 8) {
+      __m128i chars{_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos))};
+      __m128i found{_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(chars, quot), _mm_cmpeq_epi16(chars, amp)),
+				 _mm_or_si128(_mm_cmpeq_epi16(chars, lt), _mm_cmpeq_epi16(chars, gt)))};
+      int mask{_mm_movemask_epi8(found)};
+
+      if (mask != 0) {
+	while ((mask & 1) == 0) {
+	  mask >>= 2;
+	  ++pos;
+	}
+
+	break;
+      }
+    }
+#endif
+
+    while (pos < length && !isEscaped(data[pos])) ++pos;
+
+    output->append(data + begin, pos - begin);
+
+    if (pos < length) output->append(get(data[pos++]).output());
+  }
+}
+
 EntityChar EntityChar::get(QChar chr) {
-  return EntityChar(chr == '\"' ? "&quot;" :
-		    chr == '&'  ? "&amp;" :
-		    chr == '<'  ? "&lt;" :
-		    chr == '>'  ? "&gt;" :
-		    "");
+  return chr == '\"' ? EntityChar(QStringLiteral("&quot;")) :
+    chr == '&'  ? EntityChar(QStringLiteral("&amp;")) :
+    chr == '<'  ? EntityChar(QStringLiteral("&lt;")) :
+    chr == '>'  ? EntityChar(QStringLiteral("&gt;")) :
+    EntityChar();
 }
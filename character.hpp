@@ -22,15 +22,22 @@
 #include <QString>
 
 
+// The output is either a string literal, which is shared without copying, or
+// a single character, so that finding an escape never allocates.
 class EscapeChar {
 public:
   EscapeChar();
   EscapeChar(const QString& str, int inputLength);
   EscapeChar(QChar chr, int inputLength);
+  EscapeChar(const QString& str, QChar chr, int inputLength);
 
+  void appendTo(QString* text) const;
   bool isEmpty() const;
   int inputLength() const;
   QString output() const;
+  int outputLength() const;
+  void replace(QString* text, int pos) const;
+  QString text() const;
 
   static EscapeChar get(const QStringRef& text);
 
@@ -40,7 +47,8 @@ private:
   static EscapeChar getEntityWithHex(const QStringRef& text);
   static EscapeChar getEntityWithText(const QStringRef& text);
 
-  QString str_;
+  QString str_;  // null if chr_ is the output
+  QChar chr_;    // the character which the escape stands for, if it is one
   int inputLength_;
 };
 
@@ -54,6 +62,7 @@ public:
   bool isEmpty() const;
   QString output() const;
 
+  static void appendEscaped(QString* output, const QStringRef& text);
   static EntityChar get(QChar chr);
 
 private:
@@ -19,14 +19,28 @@
 
 #include "containerblock.hpp"
 
-#include <unordered_map>
-#include "htmltag.hpp"
+#include <QStringList>
 #include "leafblock.hpp"
 #include "linehandler.hpp"
 #include "inlineparser.hpp"
+#include "memstats.hpp"
 #include "parser.hpp"
 
 
+namespace {
+  // The size of the tags around a child or a container, at most
+  const int TAG_SIZE{16};
+
+  // Counts a leaf block whose HTML grew output from capacity; the leaves of a
+  // container are counted by it
+  void checkGrowth(const Block* block, const QString& output, int capacity) {
+    if (output.capacity() != capacity && block->children().isEmpty()) {
+      MemoryStats::countOutputGrowingBlock();
+    }
+  }
+}
+
+
 /////////////////////
 // Container Block //
 /////////////////////
@@ -69,6 +83,51 @@ void ContainerBlock::close() {
   disable();
 }
 
+// The HTML is reserved once from the estimate, and written in place
+QString ContainerBlock::html() const {
+  QString html{};
+  html.reserve(estimateHTMLSize());
+  appendHTML(&html);
+
+  return html;
+}
+
+int ContainerBlock::estimateHTMLSize() const {
+  int size{TAG_SIZE};
+
+  for (const Block* child : children_) {
+    size += child->estimateHTMLSize() + TAG_SIZE;
+  }
+
+  return size;
+}
+
+void ContainerBlock::appendOutline(QVector<OutlineItem>* outline) const {
+  for (const Block* child : children_) {
+    child->appendOutline(outline);
+  }
+}
+
+// The text of the children is separated by linebreaks
+void ContainerBlock::appendPlainText(QString* output) const {
+  const int begin{output->size()};
+
+  for (const Block* child : children_) {
+    const int size{output->size()};
+
+    if (size > begin) output->append('\n');
+
+    child->appendPlainText(output);
+
+    if (size > begin && output->size() == size + 1) output->chop(1);
+  }
+}
+
+// A container ends with its last child
+int ContainerBlock::lastLine() const {
+  return isEmpty() ? firstLine() : last()->lastLine();
+}
+
 void ContainerBlock::appendBlock(Block* block) {
   if (!isEmpty() && last()->writable()) {
     last()->close();
@@ -90,6 +149,10 @@ const QList<Block*> ContainerBlock::children() const {
   return children_;
 }
 
+int ContainerBlock::childCount() const {
+  return children_.size();
+}
+
 const Parser* ContainerBlock::parser() const {
   return parser_;
 }
@@ -159,7 +222,8 @@ bool ContainerBlock::dispatchContainerBlock(LineHandler* lineHandler) {
 }
 
 bool ContainerBlock::dispatchBlockQuote(LineHandler* lineHandler) {
-  if (!lineHandler->matchBlockQuote()) return false;
+  if (!(lineHandler->blockStarts() & LineHandler::BlockQuoteStart) ||
+      !lineHandler->matchBlockQuote()) return false;
 
   if (depth() < lineHandler->depth()) {
     appendBlockQuote(*lineHandler);
@@ -174,6 +238,8 @@ void ContainerBlock::appendBlockQuote(const LineHandler& lineHandler) {
 }
 
 bool ContainerBlock::dispatchBulletList(LineHandler* lineHandler) {
+  if (!(lineHandler->blockStarts() & LineHandler::BulletListStart)) return false;
+
   LineHandler copy{*lineHandler};
   int baseIndent{copy.indent()};
   QChar bullet{copy.findBullet()};
@@ -181,12 +247,7 @@ bool ContainerBlock::dispatchBulletList(LineHandler* lineHandler) {
   if (bullet.isNull()) return false;
 
   if (depth() > copy.depth()) {
-    ContainerBlock* current{this};
-    
-    do {
-      parser()->unwind();
-      current = parser()->current();
-    } while (current->depth() > copy.depth());
+    ContainerBlock* current{parser()->unwindToDepth(copy.depth())};
 
     return current->dispatchBulletList(lineHandler);
   }
@@ -216,6 +277,9 @@ void ContainerBlock::appendBulletList(QChar /*bullet*/, int /*baseIndent*/, int
 
 bool ContainerBlock::dispatchOrderedList(LineHandler* lineHandler) {
   static const QString nr1OrderedListString{"1."};
+
+  if (!(lineHandler->blockStarts() & LineHandler::OrderedListStart)) return false;
+
   LineHandler copy{*lineHandler};
   int baseIndent{copy.indent()};
   QStringRef digit{copy.findDigit()};
@@ -223,12 +287,7 @@ bool ContainerBlock::dispatchOrderedList(LineHandler* lineHandler) {
   if (digit.isEmpty()) return false;
 
   if (depth() > copy.depth()) {
-    ContainerBlock* current{this};
-    
-    do {
-      parser()->unwind();
-      current = parser()->current();
-    } while (current->depth() > copy.depth());
+    ContainerBlock* current{parser()->unwindToDepth(copy.depth())};
 
     return current->dispatchOrderedList(lineHandler);
   }
@@ -289,12 +348,7 @@ bool ContainerBlock::dispatchIndentedCode(const LineHandler& lineHandler) {
   if (removed.indent() < requirement) return false;
   
   if (depth() > lineHandler.depth()) {
-    ContainerBlock* current{this};
-    
-    do {
-      parser()->unwind();
-      current = parser()->current();
-    } while (current->depth() > lineHandler.depth());
+    ContainerBlock* current{parser()->unwindToDepth(lineHandler.depth())};
 
     current->appendIndentedText(&removed);
   } else if (isEmpty() || !last()->appendIndentedText(&removed)) {
@@ -328,7 +382,7 @@ bool ContainerBlock::appendParagraphText(const LineHandler& lineHandler) {
 
 void ContainerBlock::dispatchHeadingAndParagraph(LineHandler* lineHandler) {
   dispatchNoText(*lineHandler) ||
-    dispatchHeadingBlock(lineHandler) ||
+    ((lineHandler->blockStarts() & LineHandler::HeadingStart) && dispatchHeadingBlock(lineHandler)) ||
     appendParagraph(*lineHandler);
 }
 
@@ -340,7 +394,7 @@ bool ContainerBlock::dispatchHeadingBlock(LineHandler* lineHandler) {
   
   lineHandler->removeLastSequence('#');
   parser()->unwindUntil(currentIndent);
-  parser()->current()->appendLeafBlock(new HeadingBlock(parser()->current(), lineHandler->trimmed(), count));
+  parser()->current()->appendLeafBlock(new HeadingBlock(parser()->current(), *lineHandler, count));
 
   return true;
     
@@ -356,44 +410,44 @@ bool ContainerBlock::dispatchNoText(const LineHandler& lineHandler) {
   return true;
 }
 
+// Only the block starts possible for the first character of the line are
+// tried; continuation lines of open blocks are always offered to them.
 bool ContainerBlock::dispatchLeafBlock(LineHandler* lineHandler) {
-  return dispatchHTMLBlock(lineHandler) ||
-    dispatchFencedCodeBlock(*lineHandler) ||
-    dispatchSetextHeading(*lineHandler) ||
-    dispatchThematicBreak(*lineHandler) ||
+  const int blockStarts{lineHandler->blockStarts()};
+
+  return dispatchHTMLBlock(lineHandler, blockStarts) ||
+    ((blockStarts & LineHandler::FencedCodeStart) && dispatchFencedCodeBlock(*lineHandler)) ||
+    ((blockStarts & LineHandler::SetextUnderline) && dispatchSetextHeading(*lineHandler)) ||
+    ((blockStarts & LineHandler::ThematicBreakStart) && dispatchThematicBreak(*lineHandler)) ||
     appendFencedCodeText(*lineHandler) ||
     (!isEmpty() && last()->appendHTMLBlockText(*lineHandler));
 }
 
-bool ContainerBlock::dispatchHTMLBlock(LineHandler* lineHandler) {
-  static const HTMLTag htmlTag{};
-  
+bool ContainerBlock::dispatchHTMLBlock(LineHandler* lineHandler, int blockStarts) {
   if (!isEmpty() && (last()->closeHTMLBlock(*lineHandler) ||
 		     last()->appendHTMLBlockText(*lineHandler))) {
     return true;
   }
 
+  if (!(blockStarts & LineHandler::HTMLBlockStart)) return false;
+
   // Autolinks
   if (lineHandler->isAutolink()) return false;
 
-  // const HTMLTag& htmlTag(parser()->htmlTag());
-  
   // type 1, 2, 3, 4 and 5
-  for (auto pair : htmlTag.type12345List()) {
-    if (lineHandler->matchHTMLOpenTag(*pair.first)) {
-      HTMLBlockWithCloseTag* block{new HTMLBlockWithCloseTag(this, *lineHandler, pair.second)};
-      appendLeafBlock(block);
+  if (int type = lineHandler->matchHTMLOpenTag()) {
+    HTMLBlockWithCloseTag* block{new HTMLBlockWithCloseTag(this, *lineHandler, type)};
+    appendLeafBlock(block);
 
-      if (lineHandler->matchHTMLCloseTag(*pair.second)) {
-	block->disable();
-      }
-      
-      return true;
+    if (lineHandler->matchHTMLCloseTag(type)) {
+      block->disable();
     }
+      
+    return true;
   }
     
   // for type 6
-  if (lineHandler->matchHTMLTag(htmlTag.type6List())) {
+  if (lineHandler->matchHTMLTag()) {
     appendLeafBlock(new HTMLBlock(this, *lineHandler));
 
     return true;
@@ -401,7 +455,7 @@ bool ContainerBlock::dispatchHTMLBlock(LineHandler* lineHandler) {
 
   // for type 7
   if ((isEmpty() || !last()->writable()) &&
-      !lineHandler->matchHTMLCloseTag(htmlTag.type1CloseTag()) &&
+      !lineHandler->matchHTMLCloseTag(1) &&
       lineHandler->isHTMLTagType7()) {
     appendLeafBlock(new HTMLBlock(this, *lineHandler));
     
@@ -425,12 +479,7 @@ bool ContainerBlock::dispatchFencedCodeBlock(const LineHandler& lineHandler) {
 	if (copy.indexOf('`') >= 0) return false;
 	  
 	if (depth() > copy.depth()) {
-	  ContainerBlock* current{this};
-	    
-	  do {
-	    parser()->unwind();
-	    current = parser()->current();
-	  } while (current->depth() > copy.depth());
+	  ContainerBlock* current{parser()->unwindToDepth(copy.depth())};
 	    
 	  return current->dispatchFencedCodeBlock(lineHandler);
 	}
@@ -459,25 +508,14 @@ bool ContainerBlock::appendFencedCodeText(const LineHandler& lineHandler) {
 }
 
 bool ContainerBlock::dispatchThematicBreak(const LineHandler& lineHandler) {
-  const char markdownList[] = { '-', '*', '_' };
   int indent{lineHandler.countIndent()};
 
-  if (indent - this->indent() > 3) return false;
+  if (indent - this->indent() > 3 || !lineHandler.isThematicBreak()) return false;
   
-  QString text{lineHandler.noWhitespace()};
-  int length{text.length()};
-    
-  if (length < 3) return false;
-  
-  for (char markdown : markdownList) {
-    if (text.count(markdown) == length) {
-      parser()->unwindUntil(lineHandler.position());
-      parser()->current()->appendThematicBreak();
-      return true;
-    }
-  }
+  parser()->unwindUntil(lineHandler.position());
+  parser()->current()->appendThematicBreak();
 
-  return false;
+  return true;
 }
 
 void ContainerBlock::appendThematicBreak() {
@@ -489,6 +527,7 @@ bool ContainerBlock::dispatchSetextHeading(const LineHandler& lineHandler) {
     HeadingBlock* heading{last()->convertToSetextHeading(lineHandler)};
     
     if (heading) {
+      heading->setFirstLine(last()->firstLine());
       removeLast();
       appendLeafBlock(heading);
       return true;
@@ -510,14 +549,17 @@ BodyBlock::BodyBlock()
 BodyBlock::~BodyBlock() {
 }
 
-QString BodyBlock::html() const {
-  QStringList htmlText;
+void BodyBlock::appendHTML(QString* output) const {
+  bool isFirst{true};
 
   for (auto block : children()) {
-    htmlText.append(block->html());
-  }
+    if (!isFirst) output->append('\n');
 
-  return htmlText.join('\n');
+    const int capacity{output->capacity()};
+    block->appendHTML(output);
+    checkGrowth(block, *output, capacity);
+    isFirst = false;
+  }
 }
 
 bool BodyBlock::appendParagraph(const LineHandler& lineHandler) {
@@ -528,6 +570,10 @@ bool BodyBlock::appendParagraph(const LineHandler& lineHandler) {
   return true;
 }
 
+Block::Type BodyBlock::type() const {
+  return Document;
+}
+
 
 ////////////////
 // List Block //
@@ -602,11 +648,47 @@ void ListItem::setHasBlankline(bool hasBlankline) {
   hasBlankline_ |= hasBlankline;
 }
 
+Block::Type ListItem::type() const {
+  return Item;
+}
+
 void ListItem::appendContainerBlock(ContainerBlock* block) {
   parent()->setHasBlankline(hasBlankline_);
   ContainerBlock::appendContainerBlock(block);
 }
 
+void ListItem::appendHTML(QString* output) const {
+  static const QLatin1String openTag{"<li>\n"};
+  const int begin{output->length() + openTag.size()};
+  output->append(openTag);
+  bool isFirst{true};
+
+  for (auto block : children()) {
+    if (!isFirst) output->append('\n');
+
+    const int capacity{output->capacity()};
+    block->appendHTML(output);
+    checkGrowth(block, *output, capacity);
+    isFirst = false;
+  }
+
+  if (output->length() == begin) {
+    output->chop(1);
+    output->append(QLatin1String("</li>"));
+
+    return;
+  }
+
+  // the linebreaks around the text are only put before and after tags
+  const QChar last{output->at(output->length() - 1)};
+
+  if (output->at(begin) != '<') output->remove(begin - 1, 1);
+
+  if (last == '>') output->append('\n');
+
+  output->append(QLatin1String("</li>"));
+}
+
 void ListItem::appendLeafBlock(LeafBlock* block) {
   parent()->setHasBlankline(hasBlankline_);
   ContainerBlock::appendLeafBlock(block);
@@ -662,12 +744,7 @@ bool ListItem::dispatchIndentedCode(const LineHandler& lineHandler) {
   }
   
   if (depth() > lineHandler.depth()) {
-    ContainerBlock* current{this};
-    
-    do {
-      parser()->unwind();
-      current = parser()->current();
-    } while (current->depth() > lineHandler.depth());
+    ContainerBlock* current{parser()->unwindToDepth(lineHandler.depth())};
 
     current->appendIndentedText(&removed);
   } else if (isEmpty() || !last()->appendIndentedText(&removed)) {
@@ -737,18 +814,16 @@ bool BulletListItem::dispatchContainerBlock(LineHandler* lineHandler) {
 
 bool BulletListItem::dispatchBulletList(LineHandler* lineHandler) {
   const int bulletLength{1}; // '*' or '-'
+
+  if (!(lineHandler->blockStarts() & LineHandler::BulletListStart)) return false;
+
   LineHandler copy{*lineHandler};
   int baseIndent{copy.indent()};
   QChar bullet{copy.findBullet()};
   
   if (bullet == this->bullet()) {
     if (depth() > copy.depth()) {
-      ContainerBlock* current{this};
-      
-      do {
-	parser()->unwind();
-	current = parser()->current();
-      } while (current->depth() > copy.depth());
+      ContainerBlock* current{parser()->unwindToDepth(copy.depth())};
       
       return current->dispatchBulletList(lineHandler);
     }
@@ -776,26 +851,6 @@ bool BulletListItem::dispatchBulletList(LineHandler* lineHandler) {
   }
 }
 
-QString BulletListItem::html() const {
-  QStringList itemList;
-
-  for (auto block : children()) {
-    itemList.append(block->html());
-  }
-  
-  QString text{itemList.join('\n')};
-  
-  if (text.length() > 0) {
-    return QString(text.at(0) == '<' ?
-		   (text.at(text.length() -1) == '>' ?
-		    "<li>\n%1\n</li>" : "<li>\n%1</li>") :
-		   (text.at(text.length() -1) == '>' ?
-		    "<li>%1\n</li>" : "<li>%1</li>")).arg(text);
-  }
-
-  return QString("<li></li>");
-}
-
 bool BulletListItem::isFollowedBy(LineHandler* lineHandler, int indent) const {
   QChar bullet{lineHandler->findBullet()};
 	
@@ -822,14 +877,21 @@ void BulletListBlock::appendBulletList(QChar bullet, int baseIndent, int indent,
   setHasBlankline(hasBlankline);
 }
 
-QString BulletListBlock::html() const {
-  QString text;
+void BulletListBlock::appendHTML(QString* output) const {
+  output->append(QLatin1String("<ul>\n"));
 
   for (auto block : children()) {
-    text.append(block->html() + '\n');
+    const int capacity{output->capacity()};
+    block->appendHTML(output);
+    checkGrowth(block, *output, capacity);
+    output->append('\n');
   }
-  
-  return QString("<ul>\n%1</ul>").arg(text);
+
+  output->append(QLatin1String("</ul>"));
+}
+
+Block::Type BulletListBlock::type() const {
+  return BulletList;
 }
 
 
@@ -861,6 +923,9 @@ bool OrderedListItem::dispatchContainerBlock(LineHandler* lineHandler) {
 
 bool OrderedListItem::dispatchOrderedList(LineHandler* lineHandler) {
   const int delimiterLength{1}; // '.' or ')'
+
+  if (!(lineHandler->blockStarts() & LineHandler::OrderedListStart)) return false;
+
   LineHandler copy{*lineHandler};
   int baseIndent{copy.indent()};
   QStringRef digit{copy.findDigit()};
@@ -872,12 +937,7 @@ bool OrderedListItem::dispatchOrderedList(LineHandler* lineHandler) {
 
   if (separator_ == separator) {
     if (depth() > copy.depth()) {
-      ContainerBlock* current{this};
-      
-      do {
-	parser()->unwind();
-	current = parser()->current();
-      } while (current->depth() > copy.depth());
+      ContainerBlock* current{parser()->unwindToDepth(copy.depth())};
       
       return current->dispatchOrderedList(lineHandler);
     }
@@ -906,26 +966,6 @@ bool OrderedListItem::dispatchOrderedList(LineHandler* lineHandler) {
   }
 }
 
-QString OrderedListItem::html() const {
-  QStringList itemList;
-
-  for (auto block : children()) {
-    itemList.append(block->html());
-  }
-  
-  QString text{itemList.join('\n')};
-  
-  if (text.length() > 0) {
-    return QString(text.at(0) == '<' ?
-		   (text.at(text.length() -1) == '>' ?
-		    "<li>\n%1\n</li>" : "<li>\n%1</li>") :
-		   (text.at(text.length() -1) == '>' ?
-		    "<li>%1\n</li>" : "<li>%1</li>")).arg(text);
-  }
-
-  return QString("<li></li>");
-}
-
 bool OrderedListItem::isFollowedBy(LineHandler* lineHandler, int indent) const {
   QStringRef digit{lineHandler->findDigit()};
   
@@ -956,18 +996,25 @@ void OrderedListBlock::appendOrderedList(QChar separator, int baseIndent, int in
   setHasBlankline(hasBlankline);
 }
 
-QString OrderedListBlock::html() const {
-  QString text;
-
-  for (auto block : children()) {
-    text.append(block->html() + '\n');
-  }
-  
+void OrderedListBlock::appendHTML(QString* output) const {
   if (begin_ == 1) {
-    return QString("<ol>\n%1</ol>").arg(text);
+    output->append(QLatin1String("<ol>\n"));
   } else {
-    return QString("<ol start=\"%2\">\n%1</ol>").arg(text, QString::number(begin_));
+    output->append(QLatin1String("<ol start=\"")).append(QString::number(begin_)).append(QLatin1String("\">\n"));
+  }
+
+  for (auto block : children()) {
+    const int capacity{output->capacity()};
+    block->appendHTML(output);
+    checkGrowth(block, *output, capacity);
+    output->append('\n');
   }
+
+  output->append(QLatin1String("</ol>"));
+}
+
+Block::Type OrderedListBlock::type() const {
+  return OrderedList;
 }
 
 
@@ -984,14 +1031,17 @@ BlockQuoteBlock::BlockQuoteBlock(ContainerBlock* parent, int indent)
 BlockQuoteBlock::~BlockQuoteBlock() {
 }
 
-QString BlockQuoteBlock::html() const {
-  QString text;
+void BlockQuoteBlock::appendHTML(QString* output) const {
+  output->append(QLatin1String("<blockquote>\n"));
 
   for (auto block : children()) {
-    text.append(block->html() + '\n');
+    const int capacity{output->capacity()};
+    block->appendHTML(output);
+    checkGrowth(block, *output, capacity);
+    output->append('\n');
   }
-  
-  return QString("<blockquote>\n%1</blockquote>").arg(text);
+
+  output->append(QLatin1String("</blockquote>"));
 }
 
 bool BlockQuoteBlock::dispatchBlankLine(const LineHandler& lineHandler) {
@@ -1006,6 +1056,10 @@ void BlockQuoteBlock::handleBlankLine(const LineHandler& /* lineHandler */) {
   close();
 }
 
+Block::Type BlockQuoteBlock::type() const {
+  return BlockQuote;
+}
+
 bool BlockQuoteBlock::dispatchContainerBlock(LineHandler* lineHandler) {
   return dispatchBlockQuote(lineHandler) ||
     dispatchBulletList(lineHandler) ||
@@ -1013,7 +1067,9 @@ bool BlockQuoteBlock::dispatchContainerBlock(LineHandler* lineHandler) {
 }
 
 bool BlockQuoteBlock::dispatchBlockQuote(LineHandler* lineHandler) {
-  if (!writable() || !lineHandler->matchBlockQuote()) return false;
+  if (!writable() ||
+      !(lineHandler->blockStarts() & LineHandler::BlockQuoteStart) ||
+      !lineHandler->matchBlockQuote()) return false;
 
   if (depth() < lineHandler->depth()) {
     appendBlockQuote(*lineHandler);
@@ -1043,12 +1099,7 @@ bool BlockQuoteBlock::dispatchIndentedCode(const LineHandler& lineHandler) {
   }
 
   if (depth() > lineHandler.depth()) {
-    ContainerBlock* current{this};
-    
-    do {
-      parser()->unwind();
-      current = parser()->current();
-    } while (current->depth() > lineHandler.depth());
+    ContainerBlock* current{parser()->unwindToDepth(lineHandler.depth())};
 
     current->appendIndentedText(&removed);
   } else if (isEmpty() || !last()->appendIndentedText(&removed)) {
@@ -1077,12 +1128,7 @@ bool BlockQuoteBlock::appendParagraph(const LineHandler& lineHandler) {
   // lazy or not?
   if (isEmpty() || !last()->appendParagraphText(lineHandler)) {
     if (depth() > lineHandler.depth()) {
-      ContainerBlock* current{this};
-      
-      do {
-	parser()->unwind();
-	current = parser()->current();
-      } while (current->depth() > lineHandler.depth());
+      ContainerBlock* current{parser()->unwindToDepth(lineHandler.depth())};
       
       current->appendLeafBlock(new ParagraphBlock(current, lineHandler));
     } else {
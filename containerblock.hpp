@@ -40,7 +40,17 @@ public:
   bool appendFencedCodeText(const LineHandler& lineHandler) override;
   bool appendIndentedText(LineHandler* lineHandler) override;
   bool appendParagraphText(const LineHandler& lineHandler) override;
+  void appendOutline(QVector<OutlineItem>* outline) const override;
+  void appendPlainText(QString* output) const override;
+  const QList<Block*> children() const override;
   void close() override;
+  int estimateHTMLSize() const override;
+  QString html() const override;
+  int lastLine() const override;
+
+  // Containers write the HTML of their children straight into output, so
+  // html() is built on this
+  void appendHTML(QString* output) const override = 0;
 
   virtual void appendBulletList(QChar bullet, int baseIndent, int indent, bool hasBlankline);
   virtual void appendContainerBlock(ContainerBlock* block);
@@ -60,7 +70,7 @@ public:
   virtual bool isIndentEnoughForChild(int indent) const;
   virtual void setHasBlankline(bool hasBlankline);
 
-  const QList<Block*> children() const;
+  int childCount() const;
   int depth() const;
   void dispatchHeadingAndParagraph(LineHandler* lineHandler);
   bool dispatchLeafBlock(LineHandler* lineHandler);
@@ -83,7 +93,7 @@ private:
   void appendThematicBreak();
   bool dispatchFencedCodeBlock(const LineHandler& lineHandler);
   bool dispatchHeadingBlock(LineHandler* lineHandler);
-  bool dispatchHTMLBlock(LineHandler* lineHandler);
+  bool dispatchHTMLBlock(LineHandler* lineHandler, int blockStarts);
   bool dispatchNoText(const LineHandler& lineHandler);
   bool dispatchThematicBreak(const LineHandler& lineHandler);
 
@@ -100,8 +110,9 @@ public:
   BodyBlock();
   ~BodyBlock() override;
 
+  void appendHTML(QString* output) const override;
   bool appendParagraph(const LineHandler& lineHandler) override;
-  QString html() const override;
+  Type type() const override;
 };
 
 class ListBlock : public ContainerBlock {
@@ -130,6 +141,7 @@ public:
   ~ListItem() override;
 
   void appendContainerBlock(ContainerBlock* block) override;
+  void appendHTML(QString* output) const override;
   void appendLeafBlock(LeafBlock* block) override;
   bool appendParagraph(const LineHandler& lineHandler) override;
   int baseIndent() const override;
@@ -138,6 +150,7 @@ public:
   bool dispatchSetextHeading(const LineHandler& lineHandler) override;
   bool hasBlankline() const override;
   void setHasBlankline(bool hasBlankline) override;
+  Type type() const override;
 
 protected:
   virtual bool isFollowedBy(LineHandler* lineHandler, int indent) const = 0;
@@ -155,7 +168,6 @@ public:
 
   bool dispatchBulletList(LineHandler* lineHandler) override;
   bool dispatchContainerBlock(LineHandler* lineHandler) override;
-  QString html() const override;
   bool isFollowedBy(LineHandler* lineHandler, int indent) const override;
   bool isIndentEnoughForChild(int indent) const override;
 
@@ -172,7 +184,8 @@ public:
   ~BulletListBlock() override;
 
   void appendBulletList(QChar bullet, int baseIndent, int indent, bool hasBlankline) override;
-  QString html() const override;
+  void appendHTML(QString* output) const override;
+  Type type() const override;
 };
 
 class OrderedListItem : public ListItem {
@@ -183,7 +196,6 @@ public:
 
   bool dispatchContainerBlock(LineHandler* lineHandler) override;
   bool dispatchOrderedList(LineHandler* lineHandler) override;
-  QString html() const override;
   bool isFollowedBy(LineHandler* lineHandler, int indent) const override;
   bool isIndentEnoughForChild(int indent) const override;
 
@@ -200,8 +212,9 @@ public:
   OrderedListBlock(ContainerBlock* parent, int indent, qulonglong begin);
   ~OrderedListBlock() override;
 
+  void appendHTML(QString* output) const override;
   void appendOrderedList(QChar separator, int baseIndent, int indent, int markerLength, bool hasBlankline) override;
-  QString html() const override;
+  Type type() const override;
 
 private:
   qulonglong begin_;
@@ -215,13 +228,14 @@ public:
 
   void appendBlockQuote(const LineHandler& lineHandler) override;
   bool appendFencedCodeText(const LineHandler& lineHandler) override;
+  void appendHTML(QString* output) const override;
   bool appendParagraph(const LineHandler& lineHandler) override;
   bool dispatchBlankLine(const LineHandler& lineHandler) override;
   bool dispatchContainerBlock(LineHandler* lineHandler) override;
   bool dispatchIndentedCode(const LineHandler& lineHandler) override;
   bool dispatchSetextHeading(const LineHandler& lineHandler) override;
   void handleBlankLine(const LineHandler& lineHandler) override;
-  QString html() const override;
+  Type type() const override;
 
 private:
   bool dispatchBlockQuote(LineHandler* lineHandler);
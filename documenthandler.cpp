@@ -0,0 +1,130 @@
+// md-parser/documenthandler.cpp - callbacks for the blocks of a document
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "documenthandler.hpp"
+
+
+DocumentHandler::DocumentHandler() {
+}
+
+DocumentHandler::~DocumentHandler() {
+}
+
+bool DocumentHandler::code(const QString& /* code */, const SourceSpan& /* span */) {
+  return true;
+}
+
+bool DocumentHandler::codeSpan(const QString& /* code */, int /* begin */, int /* end */) {
+  return true;
+}
+
+bool DocumentHandler::endBlock(Block::Type /* type */, const SourceSpan& /* span */) {
+  return true;
+}
+
+bool DocumentHandler::enterSpan(InlineEvent::SpanType /* type */, int /* begin */, int /* end */) {
+  return true;
+}
+
+bool DocumentHandler::html(const QString& /* html */, const SourceSpan& /* span */) {
+  return true;
+}
+
+bool DocumentHandler::inlineText(const QString& /* source */, const SourceSpan& /* span */) {
+  return true;
+}
+
+bool DocumentHandler::leaveSpan(InlineEvent::SpanType /* type */, int /* begin */, int /* end */) {
+  return true;
+}
+
+bool DocumentHandler::link(const QString& /* destination */, const QString& /* title */) {
+  return true;
+}
+
+bool DocumentHandler::startBlock(Block::Type /* type */, const SourceSpan& /* span */) {
+  return true;
+}
+
+bool DocumentHandler::text(const QString& /* text */, int /* begin */, int /* end */) {
+  return true;
+}
+
+// Parses mdText, calling back for each block as soon as its top-level block is
+// closed.  Returns false if a callback stopped it.
+bool DocumentHandler::parse(const QString& mdText) {
+  BlockEventReader reader{mdText};
+  bool ok{true};
+
+  while (ok && reader.readNext() != BlockEventReader::EndDocument) {
+    switch (reader.eventType()) {
+    case BlockEventReader::StartBlock:
+      ok = startBlock(reader.blockType(), reader.span());
+      break;
+
+    case BlockEventReader::EndBlock:
+      ok = endBlock(reader.blockType(), reader.span());
+      break;
+
+    case BlockEventReader::Text:
+      if (reader.blockType() == Block::IndentedCode || reader.blockType() == Block::FencedCode) {
+	ok = code(reader.text(), reader.span());
+      } else if (reader.blockType() == Block::HTML) {
+	ok = html(reader.text(), reader.span());
+      } else {
+	ok = inlineText(reader.text(), reader.span()) && handleInline(reader.readInlineEvents());
+      }
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  return ok;
+}
+
+bool DocumentHandler::handleInline(const QVector<InlineEvent>& events) {
+  for (const InlineEvent& event : events) {
+    bool ok{true};
+
+    switch (event.type) {
+    case InlineEvent::Text:
+      ok = text(event.text, event.begin, event.end);
+      break;
+
+    case InlineEvent::Code:
+      ok = codeSpan(event.text, event.begin, event.end);
+      break;
+
+    case InlineEvent::EnterSpan:
+      ok = enterSpan(event.span, event.begin, event.end) &&
+	((event.span != InlineEvent::Link && event.span != InlineEvent::Image) || link(event.text, event.title));
+      break;
+
+    case InlineEvent::LeaveSpan:
+      ok = leaveSpan(event.span, event.begin, event.end);
+      break;
+    }
+
+    if (!ok) return false;
+  }
+
+  return true;
+}
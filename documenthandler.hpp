@@ -0,0 +1,59 @@
+// md-parser/documenthandler.hpp - callbacks for the blocks of a document
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <QString>
+#include "block.hpp"
+#include "blockeventreader.hpp"
+#include "inlineparser.hpp"
+
+
+// Receives the blocks of a document from parse(), in the manner of
+// QXmlContentHandler, without any HTML being built.  Each callback returns
+// false to stop parsing; the default ones do nothing.  code() gets the content
+// of a code block and html() the lines of an HTML block, each with the source
+// of its block.  For a paragraph or a heading, inlineText() gets its inline
+// source, and then text(), codeSpan(), enterSpan() and leaveSpan() get its
+// inline elements with the positions [begin, end) of their source in the
+// document, markup left out as in Parser::getPlainText().  link() follows
+// enterSpan() of a link or an image.
+class DocumentHandler {
+public:
+  DocumentHandler();
+  DocumentHandler(const DocumentHandler& other) = delete;
+  DocumentHandler& operator=(const DocumentHandler& other) = delete;
+  virtual ~DocumentHandler();
+
+  virtual bool code(const QString& code, const SourceSpan& span);
+  virtual bool codeSpan(const QString& code, int begin, int end);
+  virtual bool endBlock(Block::Type type, const SourceSpan& span);
+  virtual bool enterSpan(InlineEvent::SpanType type, int begin, int end);
+  virtual bool html(const QString& html, const SourceSpan& span);
+  virtual bool inlineText(const QString& source, const SourceSpan& span);
+  virtual bool leaveSpan(InlineEvent::SpanType type, int begin, int end);
+  virtual bool link(const QString& destination, const QString& title);
+  virtual bool startBlock(Block::Type type, const SourceSpan& span);
+  virtual bool text(const QString& text, int begin, int end);
+
+  bool parse(const QString& mdText);
+
+private:
+  bool handleInline(const QVector<InlineEvent>& events);
+};
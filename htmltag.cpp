@@ -19,107 +19,145 @@
 
 #include "htmltag.hpp"
 
+#include <cstring>
+#include <QString>
 
-HTMLTag::HTMLTag()
-  : type1CloseTag_("</(script|pre|style)>"),
-    type12345List_(),
-    type6List_()
-{
-  // HTML tag (type 1)
-  type12345List_.append(qMakePair(new QRegularExpression("^\\s*<(script|pre|style)([\\s>].*|)$"), new QRegularExpression(type1CloseTag_)));
-  
-  // HTML tag (type 2, 3, 4 and 5)
-  appendType12345("^\\s*<!--", "-->");
-  appendType12345("^\\s*<\\?", "\\?>");
-  appendType12345("^\\s*<![A-Z]", ">");
-  appendType12345("^\\s*<!\\[CDATA\\[", "]]>");
-
-  // HTML tag (type 6)
-  type6List_.prepend("address");
-  type6List_.prepend("article");
-  type6List_.prepend("aside");
-  type6List_.prepend("base");
-  type6List_.prepend("basefont");
-  type6List_.prepend("blockquote");
-  type6List_.prepend("body");
-  type6List_.prepend("caption");
-  type6List_.prepend("center");
-  type6List_.prepend("col");
-  type6List_.prepend("colgroup");
-  type6List_.prepend("dd");
-  type6List_.prepend("details");
-  type6List_.prepend("dialog");
-  type6List_.prepend("dir");
-  type6List_.prepend("div");
-  type6List_.prepend("dl");
-  type6List_.prepend("dt");
-  type6List_.prepend("fieldset");
-  type6List_.prepend("figcaption");
-  type6List_.prepend("figure");
-  type6List_.prepend("footer");
-  type6List_.prepend("form");
-  type6List_.prepend("frame");
-  type6List_.prepend("frameset");
-  type6List_.prepend("h1");
-  type6List_.prepend("h2");
-  type6List_.prepend("h3");
-  type6List_.prepend("h4");
-  type6List_.prepend("h5");
-  type6List_.prepend("h6");
-  type6List_.prepend("head");
-  type6List_.prepend("header");
-  type6List_.prepend("hr");
-  type6List_.prepend("html");
-  type6List_.prepend("iframe");
-  type6List_.prepend("legend");
-  type6List_.prepend("li");
-  type6List_.prepend("link");
-  type6List_.prepend("main");
-  type6List_.prepend("menu");
-  type6List_.prepend("menuitem");
-  type6List_.prepend("meta");
-  type6List_.prepend("nav");
-  type6List_.prepend("noframes");
-  type6List_.prepend("ol");
-  type6List_.prepend("optgroup");
-  type6List_.prepend("option");
-  type6List_.prepend("p");
-  type6List_.prepend("param");
-  type6List_.prepend("section");
-  type6List_.prepend("source");
-  type6List_.prepend("summary");
-  type6List_.prepend("table");
-  type6List_.prepend("tbody");
-  type6List_.prepend("td");
-  type6List_.prepend("tfoot");
-  type6List_.prepend("th");
-  type6List_.prepend("thead");
-  type6List_.prepend("title");
-  type6List_.prepend("tr");
-  type6List_.prepend("track");
-  type6List_.prepend("ul");
-}
 
-HTMLTag::~HTMLTag() {
-  for (auto pair : type12345List_) {
-    delete pair.first;
-    delete pair.second;
+namespace {
+  // tag names of HTML blocks (type 1)
+  const char* const type1TagList[]{ "script", "pre", "style" };
+
+  // tag names of HTML blocks (type 6), in descending order
+  const char* const type6TagList[]{
+    "ul", "track", "tr", "title", "thead", "th", "tfoot", "td", "tbody", "table",
+    "summary", "source", "section", "param", "p", "option", "optgroup", "ol",
+    "noframes", "nav", "meta", "menuitem", "menu", "main", "link", "li", "legend",
+    "iframe", "html", "hr", "header", "head", "h6", "h5", "h4", "h3", "h2", "h1",
+    "frameset", "frame", "form", "footer", "figure", "figcaption", "fieldset",
+    "dt", "dl", "div", "dir", "dialog", "details", "dd", "colgroup", "col",
+    "center", "caption", "body", "blockquote", "basefont", "base", "aside",
+    "article", "address"
+  };
+
+  // same as '\s' of the regular expressions
+  bool isWhitespace(QChar chr) {
+    return chr == ' ' || chr == '\t' || chr == '\n' || chr == '\v' || chr == '\f' || chr == '\r';
   }
-}
 
-void HTMLTag::appendType12345(const QString& openTag, const QString& closeTag) {
-  type12345List_.append(qMakePair(new QRegularExpression(openTag), new QRegularExpression(closeTag)));
-}
+  bool startsWith(const QStringRef& text, int pos, const char* str) {
+    for (int i{0}; str[i] != '\0'; ++i, ++pos) {
+      if (pos >= text.length() || text.at(pos) != QLatin1Char(str[i])) return false;
+    }
+
+    return true;
+  }
+
+  // same as QString::compare(), but of a tag name and the beginning of text
+  int compareTagName(const char* tagName, const QStringRef& text) {
+    int length{text.length()};
 
-const QRegularExpression& HTMLTag::type1CloseTag() const {
-  return type1CloseTag_;
+    for (int i{0}; tagName[i] != '\0'; ++i) {
+      if (i >= length) return 1;
+
+      ushort chr{text.at(i).unicode()};
+      ushort tagChr{static_cast<unsigned char>(tagName[i])};
+
+      if (tagChr != chr) return tagChr < chr ? -1 : 1;
+    }
+
+    return 0;
+  }
 }
 
-const QList<QPair<QRegularExpression*, QRegularExpression*> >& HTMLTag::type12345List() const {
-  return type12345List_;
+
+// Returns the type (1-5) of the HTML block which the line begins, or 0
+int HTMLTag::findOpenTag(const QStringRef& line) {
+  int pos{0};
+  int length{line.length()};
+
+  while (pos < length && isWhitespace(line.at(pos))) ++pos;
+
+  if (!startsWith(line, pos++, "<")) return 0;
+
+  // type 1
+  for (const char* tagName : type1TagList) {
+    if (startsWith(line, pos, tagName)) {
+      int end{pos + static_cast<int>(std::strlen(tagName))};
+
+      if (end >= length || isWhitespace(line.at(end)) || line.at(end) == '>') return 1;
+    }
+  }
+
+  // type 2, 3, 4 and 5
+  if (startsWith(line, pos, "!--")) return 2;
+
+  if (startsWith(line, pos, "?")) return 3;
+
+  if (startsWith(line, pos, "!") && pos + 1 < length &&
+      line.at(pos + 1) >= 'A' && line.at(pos + 1) <= 'Z') {
+    return 4;
+  }
+
+  if (startsWith(line, pos, "![CDATA[")) return 5;
+
+  return 0;
 }
 
-const QStringList& HTMLTag::type6List() const {
-  return type6List_;
+bool HTMLTag::hasCloseTag(int type, const QStringRef& text) {
+  switch (type) {
+  case 1:
+    return text.indexOf(QLatin1String("</script>")) >= 0 ||
+      text.indexOf(QLatin1String("</pre>")) >= 0 ||
+      text.indexOf(QLatin1String("</style>")) >= 0;
+  case 2:
+    return text.indexOf(QLatin1String("-->")) >= 0;
+  case 3:
+    return text.indexOf(QLatin1String("?>")) >= 0;
+  case 4:
+    return text.indexOf(QLatin1Char('>')) >= 0;
+  case 5:
+    return text.indexOf(QLatin1String("]]>")) >= 0;
+  default:
+    return false;
+  }
 }
 
+bool HTMLTag::isType6Tag(const QStringRef& text) {
+  int pos{0};
+  int length{text.length()};
+
+  while (pos < length - 3) {
+    if (text.at(pos).isSpace()) {
+      ++pos;
+    } else {
+      if (text.at(pos++) != '<') return false;
+
+      if (text.at(pos) == '/') ++pos;
+      
+      QStringRef temp{text.mid(pos)};
+      length -= pos;
+      
+      for (const char* tagName : type6TagList) {
+	pos = static_cast<int>(std::strlen(tagName));
+	int result = compareTagName(tagName, temp);
+
+	if (result > 0) {
+	  continue;
+	} else if (result < 0) {
+	  return false;
+	} else if (pos >= length) {
+	  return true;
+	} else {
+	  QChar chr{temp.at(pos)};
+	  
+	  return chr.isSpace() || chr == '>' ||
+	    (chr == '/' && ++pos < length && temp.at(pos) == '>');
+	}
+      }
+      
+      return false;
+    }
+  }
+
+  return false;
+}
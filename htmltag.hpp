@@ -19,27 +19,16 @@
 
 #pragma once
 
-#include <QList>
-#include <QPair>
-#include <QStringList>
-#include <QRegularExpression>
+#include <QStringRef>
 
 
+// Start and end conditions of HTML blocks.  They are matched by hand against
+// constant tables, so nothing has to be built before the first line is parsed.
 class HTMLTag {
 public:
-  HTMLTag();
-  HTMLTag(const HTMLTag& other) = delete;
-  HTMLTag& operator=(const HTMLTag& other) = delete;
-  ~HTMLTag();
-  
-  const QRegularExpression& type1CloseTag() const;
-  const QList<QPair<QRegularExpression*, QRegularExpression*> >& type12345List() const;
-  const QStringList& type6List() const;
+  HTMLTag() = delete;
 
-private:
-  void appendType12345(const QString& openTag, const QString& closeTag);
-
-  QRegularExpression type1CloseTag_;
-  QList<QPair<QRegularExpression*, QRegularExpression*> > type12345List_;
-  QStringList type6List_;
+  static bool hasCloseTag(int type, const QStringRef& text);
+  static bool isType6Tag(const QStringRef& text);
+  static int findOpenTag(const QStringRef& line);
 };
@@ -20,17 +20,52 @@
 #include "inlineparser.hpp"
 
 #include <QLinkedList>
-#include <QRegularExpression>
-#include <QUrl>
 #include "character.hpp"
+#include "memstats.hpp"
 #include "parser.hpp"
 #include "precedence.hpp"
 #include "texthandler.hpp"
 
 
+namespace {
+  // Replaces each run of spaces and line breaks in a code span with a space.
+  QString collapseSpaces(const QStringRef& text) {
+    QString collapsed{};
+    collapsed.reserve(text.length());
+    bool inRun{false};
+
+    for (QChar chr : text) {
+      if (chr == ' ' || chr == '\n') {
+	if (!inRun) collapsed.append(QLatin1Char(' '));
+
+	inRun = true;
+      } else {
+	collapsed.append(chr);
+	inRun = false;
+      }
+    }
+
+    return collapsed;
+  }
+
+  // Returns text written by EntityChar::appendEscaped() as it was, as a link
+  // definition is kept
+  QString decodeEscaped(QString text) {
+    return text.replace(QLatin1String("&quot;"), QLatin1String("\""))
+      .replace(QLatin1String("&lt;"), QLatin1String("<"))
+      .replace(QLatin1String("&gt;"), QLatin1String(">"))
+      .replace(QLatin1String("&amp;"), QLatin1String("&"));
+  }
+}
+
+
 InlineParser::InlineParser(const QString& line, const Parser* parser)
   : line_(line),
-    parser_(parser)
+    parser_(parser),
+    plain_(false),
+    offsets_(),
+    replacements_(),
+    linkEvents_()
 {}
 
 QString InlineParser::textToHTML() {
@@ -64,7 +99,7 @@ QString InlineParser::textToHTML() {
     lastPos = pending.pop()->htmlRightPart(&temp, lastPos);
   }
 
-  temp.append(line_.right(line_.length() - lastPos));
+  temp.append(line_.midRef(lastPos));
 
   return temp;
 }
@@ -100,25 +135,108 @@ QString InlineParser::textToPlain() {
     lastPos = pending.pop()->plainTextRightPart(&temp, lastPos);
   }
 
-  temp.append(line_.right(line_.length() - lastPos));
+  temp.append(line_.midRef(lastPos));
 
   return temp;
 }
 
-QString InlineParser::codeToHTML() {
-  EntityChar entity;
+// Unlike textToPlain(), which makes alt text for HTML, entities and escapes are
+// decoded, and neither links nor HTML tags are formatted
+QString InlineParser::textToPlainText() {
+  plain_ = true;
 
-  for (int pos{0}; pos < line_.length(); ++pos) {
-    if (!(entity = EntityChar::get(line_.at(pos))).isEmpty()) {
-      line_.replace(pos, 1, entity.output());
-      pos += entity.output().length() - 1;
+  return textToPlain();
+}
+
+// Returns the inline elements of the text as textToPlainText() leaves them, with
+// the offsets of their source.  Spans enclose the events of their content, and
+// the text of a link is given by its events only.
+QVector<InlineEvent> InlineParser::textToEvents() {
+  plain_ = true;
+  offsets_.resize(line_.length() + 1);
+
+  for (int i{0}; i < offsets_.size(); ++i) offsets_[i] = i;
+
+  QLinkedList<Precedence> split{parse(false)};
+  QVector<InlineEvent> events{};
+  int lastPos{0};
+  int next{0};
+  QStack<const Precedence*> pending{};
+  
+  for (const Precedence& current : split) {
+    if (current.isIncomplete()) continue;
+
+    while (!pending.isEmpty()) {
+      const Precedence* last{pending.last()};
+
+      if (current.isAheadOf(last->end())) {
+	break;
+      } else {
+	pending.pop();
+	lastPos = appendSpanEvents(*last, InlineEvent::LeaveSpan, lastPos, &next, &events);
+      }
     }
+
+    lastPos = appendSpanEvents(current, InlineEvent::EnterSpan, lastPos, &next, &events);
+    pending.append(&current);
   }
 
-  return line_;
+  while (!pending.isEmpty()) {
+    lastPos = appendSpanEvents(*pending.pop(), InlineEvent::LeaveSpan, lastPos, &next, &events);
+  }
+
+  appendTextEvents(lastPos, line_.length(), &next, &events);
+
+  return events;
+}
+
+// Appends the text up to the delimiters of span on the side of type, and the
+// event of the side, in the manner of Precedence::plainTextLeftPart() and
+// plainTextRightPart()
+int InlineParser::appendSpanEvents(const Precedence& span, InlineEvent::Type type, int lastPos, int* next,
+				   QVector<InlineEvent>* events) const {
+  const int count{span.isStrong() ? 2 : 1};
+  appendTextEvents(lastPos, type == InlineEvent::EnterSpan ? span.begin() : span.end() - count, next, events);
+  events->append(InlineEvent{type, span.isStrong() ? InlineEvent::Strong : InlineEvent::Emphasis,
+			     QString(), QString(), sourceOffset(span.begin()), sourceOffset(span.end())});
+
+  return type == InlineEvent::EnterSpan ? span.begin() + count : span.end();
+}
+
+// Appends the text of line_ from begin to end, with the replacements in it from
+// the next one
+void InlineParser::appendTextEvents(int begin, int end, int* next, QVector<InlineEvent>* events) const {
+  for (; *next < replacements_.size() && replacements_.at(*next).end <= end; ++*next) {
+    const Replacement& replacement{replacements_.at(*next)};
+
+    if (replacement.begin > begin) {
+      events->append(InlineEvent{InlineEvent::Text, InlineEvent::NoSpan, line_.mid(begin, replacement.begin - begin),
+				 QString(), sourceOffset(begin), replacement.events.first().begin});
+    }
+
+    events->append(replacement.events);
+    begin = replacement.end;
+  }
+
+  if (end > begin) {
+    events->append(InlineEvent{InlineEvent::Text, InlineEvent::NoSpan, line_.mid(begin, end - begin),
+			       QString(), sourceOffset(begin), sourceOffset(end)});
+  }
+}
+
+int InlineParser::sourceOffset(int pos) const {
+  return offsets_.at(qMin(pos, offsets_.size() - 1));
+}
+
+QString InlineParser::codeToHTML() {
+  QString html{};
+  EntityChar::appendEscaped(&html, QStringRef(&line_));
+
+  return html;
 };
 
 QLinkedList<Precedence> InlineParser::parse(bool isHTML) {
+  MemoryPhase memoryPhase{MemoryStats::InlineParsing};
   QLinkedList<Precedence> split;
   QStack<Precedence*> pending;
   int pos{skipWhitespace(0)};
@@ -126,8 +244,8 @@ QLinkedList<Precedence> InlineParser::parse(bool isHTML) {
   
   while (pos < line_.length()) {
     if (pos != (temp = replaceSquareBrackets(pos)) ||
-	pos != (temp = replaceLink(pos, isHTML)) ||
-	pos != (temp = replaceImage(pos, isHTML)) ||
+	(temp = replaceLink(pos, isHTML)) >= 0 ||
+	(temp = replaceImage(pos, isHTML)) >= 0 ||
 	pos != (temp = replaceCodeSpan(pos)) ||
 	pos != (temp = replaceSpecialCharacter(pos)) ||
 	pos != (temp = replaceWhitespace(pos)) ||
@@ -212,17 +330,111 @@ int InlineParser::skipWhitespace(int pos) const {
 int InlineParser::replaceSquareBrackets(int begin) {
   int pos{begin};
   int temp;
-  TextHandler text{line_};
 
   if (pos == (temp = replaceAutolink(pos)) &&
-      pos == (temp = text.skipHTMLBlock(pos))) {
+      pos == (temp = TextHandler(line_).skipHTMLBlock(pos))) {
     return begin;
   }
 
+  if (plain_ && line_.at(pos) == '<' && temp > pos) {
+    replaceText(pos, temp - pos, QString()); // an HTML tag
+    temp = pos;
+  }
+
   return (temp < line_.length() && line_.at(temp) == '<') ?
     replaceSquareBrackets(temp) : temp;
 }
 
+// Sets *text to linkText without markup and returns true, if label is defined.
+// The text may be empty, as of [](/url).
+bool InlineParser::plainLinkText(const QString& label, const QString& linkText, int textBegin, QString* text) {
+  if (!parser_->hasLink(label)) return false;
+
+  *text = plainText(linkText, textBegin);
+
+  return true;
+}
+
+// Returns the text of a link or an image, which is at textBegin in line_,
+// without markup.  For textToEvents(), its events are kept in linkEvents_.
+QString InlineParser::plainText(const QString& text, int textBegin) {
+  InlineParser parser{text, parser_};
+
+  if (offsets_.isEmpty()) return parser.textToPlainText();
+
+  linkEvents_ = parser.textToEvents();
+  QString plain{};
+
+  for (InlineEvent& event : linkEvents_) {
+    event.begin = sourceOffset(textBegin + event.begin);
+    event.end = sourceOffset(textBegin + event.end);
+
+    if (event.type == InlineEvent::Text || event.type == InlineEvent::Code) plain.append(event.text);
+  }
+
+  return plain;
+}
+
+// Replaces the text of line_ from begin, keeping offsets_ for textToEvents(); the
+// new characters have the offset of the first one replaced
+void InlineParser::replaceText(int begin, int length, const QString& text) {
+  line_.replace(begin, length, text);
+
+  if (offsets_.isEmpty()) return;
+
+  const int offset{offsets_.at(begin)};
+  offsets_.remove(begin, length);
+  offsets_.insert(begin, text.length(), offset);
+}
+
+// Replaces a link or an image with its text.  For textToEvents(), it is kept in
+// replacements_ with linkEvents_ as the events of the text, and the destination
+// and the title are plain text, as findLinkDestination() and findLinkTitle()
+// leave them in plain_ mode.
+void InlineParser::replaceWithLink(InlineEvent::SpanType type, int begin, int length, const QString& text,
+				   const QString& destination, const QString& title) {
+  if (offsets_.isEmpty()) {
+    line_.replace(begin, length, text);
+
+    return;
+  }
+
+  const int sourceBegin{sourceOffset(begin)};
+  const int sourceEnd{sourceOffset(begin + length)};
+  Replacement link{begin, begin + text.length(), {}};
+  link.events.append(InlineEvent{InlineEvent::EnterSpan, type, TextHandler(destination).convertToPercentEncoding(),
+				 title, sourceBegin, sourceEnd});
+  link.events.append(linkEvents_);
+  link.events.append(InlineEvent{InlineEvent::LeaveSpan, type, QString(), QString(), sourceBegin, sourceEnd});
+  linkEvents_.clear();
+  replaceText(begin, length, text);
+
+  // an image in the text of a link was replaced before the link, and is left
+  // as its description
+  while (!replacements_.isEmpty() && replacements_.last().begin > begin) replacements_.removeLast();
+
+  replacements_.append(link);
+}
+
+// Drops the replacements made in the text of what turns out not to be a link,
+// as the text is parsed again, and returns -1
+int InlineParser::failLink(int replacements) {
+  replacements_.resize(replacements);
+
+  return -1;
+}
+
+void InlineParser::replaceWithReference(InlineEvent::SpanType type, int begin, int length, const QString& text,
+					const QString& label) {
+  QString reference{};
+  QString title{};
+
+  if (!offsets_.isEmpty()) parser_->findLink(label, &reference, &title);
+
+  // definitions are kept as they are written in HTML
+  replaceWithLink(type, begin, length, text, decodeEscaped(reference), decodeEscaped(title));
+}
+
 int InlineParser::replaceAutolink(int begin) {
   if (begin >= line_.length() || line_.at(begin) != '<') return begin;
 
@@ -253,16 +465,29 @@ int InlineParser::replaceAutolink(int begin) {
 }
 
 int InlineParser::applyAutolink(int begin, int pos) {
-  static const QString autolinkTemplate{"<a href=\"%1\">%2</a>"};
-
   while (++pos < line_.length()) {
     QChar chr{line_.at(pos)};
     
     if (chr == '<') return begin;
     
     if (chr == '>') {
-      QString uri{autolinkTemplate.arg(TextHandler(line_.mid(begin + 1, pos - begin - 1)).convertToPercentEncoding(),
-						TextHandler(line_.mid(begin + 1, pos - begin - 1)).convertEntityReferecence())};
+      if (plain_) {
+	QString uri{line_.mid(begin + 1, pos - begin - 1)};
+
+	if (!offsets_.isEmpty()) {
+	  linkEvents_ = {InlineEvent{InlineEvent::Text, InlineEvent::NoSpan, uri, QString(),
+				     sourceOffset(begin + 1), sourceOffset(pos)}};
+	}
+
+	replaceWithLink(InlineEvent::Link, begin, pos - begin + 1, uri, uri, QString());
+
+	return pos - 1;
+      }
+
+      TextHandler text{line_.midRef(begin + 1, pos - begin - 1)};
+      QString uri{QLatin1String("<a href=\"")};
+      text.appendPercentEncoded(&uri);
+      uri.append(QLatin1String("\">")).append(text.convertEntityReferecence()).append(QLatin1String("</a>"));
 
       line_.replace(begin, pos - begin + 1, uri);
 
@@ -284,6 +509,19 @@ int InlineParser::applyEmailAutolink(int begin, int pos) {
     if (chr == '<') return begin;
     
     if (chr == '>') {
+      if (plain_) {
+	QString address{line_.mid(begin + 1, pos - begin - 1)};
+
+	if (!offsets_.isEmpty()) {
+	  linkEvents_ = {InlineEvent{InlineEvent::Text, InlineEvent::NoSpan, address, QString(),
+				     sourceOffset(begin + 1), sourceOffset(pos)}};
+	}
+
+	replaceWithLink(InlineEvent::Link, begin, pos - begin + 1, address, QLatin1String("mailto:") + address, QString());
+
+	return pos - 1;
+      }
+
       QString address{emailAutolinkTemplate.arg(line_.mid(begin + 1, pos - begin - 1))};
 
       line_.replace(begin, pos - begin + 1, address);
@@ -297,78 +535,74 @@ int InlineParser::applyEmailAutolink(int begin, int pos) {
   return begin;
 }
 
+// The link and image functions return the end of the replacement in line_, or
+// -1 if there is no link; the end is begin if the text of a link is empty.
 int InlineParser::replaceLink(int begin, bool isHTML) {
-  if (line_.at(begin) != '[') return begin;
+  if (line_.at(begin) != '[') return -1;
 
+  const int replacements{replacements_.size()};
   int lineEnd{line_.length()};
   int count{1};
-  QString linkLabel{};
+  // The label is labelHead, set at an image, followed by line_ from labelBegin.
+  QString labelHead{};
+  int labelBegin{begin + 1};
 
   for (int pos{begin + 1}; pos < lineEnd; ++pos) {
     QChar chr{line_.at(pos)};
 
     if (chr == '\\') {
-      linkLabel.append(chr);
       ++pos;
-      linkLabel.append(line_.at(pos));
     } else if (chr == '[') {
       ++count;
-      linkLabel.append(chr);
     } else if (chr == ']') {
       if (--count <= 0) {
-	return applyLink(begin, pos, linkLabel, isHTML);
+	QString linkLabel{labelHead};
+	linkLabel.append(line_.midRef(labelBegin, pos - labelBegin));
+
+	int end{applyLink(begin, pos, linkLabel, isHTML)};
+
+	return end >= 0 ? end : failLink(replacements);
       } else if (pos + 1 >= lineEnd ||
 		 line_.at(pos + 1) == '(' ||
 		 line_.at(pos + 1) == '[') {
-	return begin;
+	return failLink(replacements);
       }
-
-      linkLabel.append(chr);
     } else if (chr == '!') {
       if (pos + 1 >= lineEnd) break;
 
-      int lengthOfText{replaceImage(pos, isHTML)};
-      linkLabel = line_.mid(begin + 1, lengthOfText - 1);
+      int imageEnd{replaceImage(pos, isHTML)};
 
-      if (lengthOfText > 0 && --count <= 0) {
-	return applyLink(begin, begin + lengthOfText, linkLabel, isHTML);
+      if (imageEnd >= 0) {
+	// the label goes on after the image, which is already replaced
+	labelHead = line_.mid(begin + 1, imageEnd - begin - 1);
+	labelBegin = imageEnd;
+	lineEnd = line_.length();
+	pos = imageEnd - 1;
       }
     } else if (chr == '<') {
       int tempPos{replaceSquareBrackets(pos)};
 
       if (tempPos != pos) return tempPos;
-
-      linkLabel.append(chr);
     } else if (chr == '`') {
-      linkLabel.append(chr);
-
       for (;;) {
-	if (++pos >= lineEnd) return begin;
+	if (++pos >= lineEnd) return failLink(replacements);
 
 	QChar chr{line_.at(pos)};
-	linkLabel.append(chr);
 
 	if (chr == '\\') {
 	  ++pos;
-	  linkLabel.append(line_.at(pos));
 	} else if (chr== '`') {
 	  break;
 	}
       }
-
-      continue;
-    } else {
-      linkLabel.append(chr);
     }
   }
   
-  return begin;
+  return failLink(replacements);
 }
 
 int InlineParser::replaceImage(int begin, bool isHTML) {
-  static const QString imageReferenceString{"!["};
-
-  if (line_.mid(begin, 2) != imageReferenceString) return begin;
+  if (line_.midRef(begin, 2) != QLatin1String("![")) return -1;
 
   int lineEnd{line_.length()};
   int count{1};
@@ -390,7 +624,7 @@ int InlineParser::replaceImage(int begin, bool isHTML) {
       if (tempPos != pos) return tempPos;
     } else if (chr == '`') {
       for (;;) {
-	if (++pos >= lineEnd) return begin;
+	if (++pos >= lineEnd) return -1;
 
 	QChar chr{line_.at(pos)};
 
@@ -403,7 +637,7 @@ int InlineParser::replaceImage(int begin, bool isHTML) {
     }
   }
   
-  return begin;
+  return -1;
 }
 
 int InlineParser::applyLink(int begin, int pos, const QString& linkLabel, bool isHTML) {
@@ -413,34 +647,32 @@ int InlineParser::applyLink(int begin, int pos, const QString& linkLabel, bool i
     return applyFullReferenceLink(begin, pos + 1, linkLabel, isHTML);
   }
 
-  int lengthOfText{applyInlineLink(begin, pos + 1, InlineParser(linkLabel, parser_).textToHTML(), isHTML)};
+  InlineParser label{linkLabel, parser_};
+  int end{applyInlineLink(begin, pos + 1, plain_ ? plainText(linkLabel, begin + 1) : label.textToHTML(), isHTML)};
 
-  return begin + (lengthOfText > 0 ?
-		  lengthOfText :
-		  applyShortcutReferenceLink(begin, pos, linkLabel, isHTML));
+  return end >= 0 ? end : applyShortcutReferenceLink(begin, pos, linkLabel, isHTML);
 }
 
 int InlineParser::applyImage(int begin, int pos, bool isHTML) {
   const int lineEnd{line_.length()};
   const int labelBegin{begin + 2};
   const int labelEnd{pos};
-  const QString linkLabel{line_.mid(labelBegin, labelEnd - labelBegin).trimmed()};
+  const QString linkLabel{line_.midRef(labelBegin, labelEnd - labelBegin).trimmed().toString()};
 
   if (pos + 1 < lineEnd && line_.at(pos + 1) == '[') {
     return applyFullReferenceImage(begin, pos + 1, linkLabel, isHTML);
   }
 
-  int lengthOfText{applyInlineImage(begin, pos + 1, InlineParser(linkLabel, parser_).textToPlain(), isHTML)};
+  InlineParser label{linkLabel, parser_};
+  int end{applyInlineImage(begin, pos + 1, plain_ ? plainText(linkLabel, skipWhitespace(labelBegin)) : label.textToPlain(), isHTML)};
 
-  return begin + (lengthOfText > 0 ?
-		  lengthOfText :
-		  applyShortcutReferenceImage(begin, pos, linkLabel, isHTML));
+  return end >= 0 ? end : applyShortcutReferenceImage(begin, pos, linkLabel, isHTML);
 }
 
 int InlineParser::applyFullReferenceLink(int begin, int pos, const QString& linkText, bool isHTML) {
   int lineEnd{line_.length()};
 
-  if (pos >= lineEnd || line_.at(pos) != '[') return begin;
+  if (pos >= lineEnd || line_.at(pos) != '[') return -1;
 
   int count{1};
   int labelBegin{pos + 1};
@@ -454,15 +686,18 @@ int InlineParser::applyFullReferenceLink(int begin, int pos, const QString& link
       ++count;
     } else if (chr == ']') {
       if (--count <= 0) {
-	QString linkLabel{line_.mid(labelBegin, pos - labelBegin).trimmed()};
+	QString linkLabel{line_.midRef(labelBegin, pos - labelBegin).trimmed().toString()};
 	if (linkLabel.isEmpty()) linkLabel = linkText;
-	QString text{parser_->getLinkText(linkLabel, linkText)};
+	QString text{};
 	++pos;
 
-	if (text.isEmpty()) return begin;
+	if (plain_ ? !plainLinkText(linkLabel, linkText, begin + 1, &text) :
+	    (text = parser_->getLinkText(linkLabel, linkText)).isEmpty()) {
+	  return -1;
+	}
 
-	if (!isHTML) text = linkLabel;
-	line_.replace(begin, pos - begin, text);
+	if (!isHTML && !plain_) text = linkLabel;
+	replaceWithReference(InlineEvent::Link, begin, pos - begin, text, linkLabel);
 	
 	return begin + text.length();
       }
@@ -472,7 +707,7 @@ int InlineParser::applyFullReferenceLink(int begin, int pos, const QString& link
       if (tempPos != pos) return tempPos;
     } else if (chr == '`') {
       for (;;) {
-	if (++pos >= lineEnd) return begin;
+	if (++pos >= lineEnd) return -1;
 
 	QChar chr{line_.at(pos)};
 
@@ -485,13 +720,13 @@ int InlineParser::applyFullReferenceLink(int begin, int pos, const QString& link
     }
   }
   
-  return begin;
+  return -1;
 }
 
 int InlineParser::applyFullReferenceImage(int begin, int pos, const QString& description, bool isHTML) {
   int lineEnd{line_.length()};
 
-  if (pos >= lineEnd || line_.at(pos) != '[') return begin;
+  if (pos >= lineEnd || line_.at(pos) != '[') return -1;
 
   int count{1};
   int labelBegin{pos + 1};
@@ -505,15 +740,18 @@ int InlineParser::applyFullReferenceImage(int begin, int pos, const QString& des
       ++count;
     } else if (chr == ']') {
       if (--count <= 0) {
-	QString linkLabel{line_.mid(labelBegin, pos - labelBegin).trimmed()};
+	QString linkLabel{line_.midRef(labelBegin, pos - labelBegin).trimmed().toString()};
 	if (linkLabel.isEmpty()) linkLabel = description;
-	QString text{parser_->getImageText(linkLabel, description)};
+	QString text{};
 	++pos;
 
-	if (text.isEmpty()) return begin;
+	if (plain_ ? !plainLinkText(linkLabel, description, skipWhitespace(begin + 2), &text) :
+	    (text = parser_->getImageText(linkLabel, description)).isEmpty()) {
+	  return -1;
+	}
 
-	if (!isHTML) text = linkLabel;
-	line_.replace(begin, pos - begin, text);
+	if (!isHTML && !plain_) text = linkLabel;
+	replaceWithReference(InlineEvent::Image, begin, pos - begin, text, linkLabel);
 
 	return begin + text.length();
       }
@@ -523,7 +761,7 @@ int InlineParser::applyFullReferenceImage(int begin, int pos, const QString& des
       if (tempPos != pos) return tempPos;
     } else if (chr == '`') {
       for (;;) {
-	if (++pos >= lineEnd) return begin;
+	if (++pos >= lineEnd) return -1;
 
 	QChar chr{line_.at(pos)};
 
@@ -536,15 +774,18 @@ int InlineParser::applyFullReferenceImage(int begin, int pos, const QString& des
     }
   }
   
-  return begin;
+  return -1;
 }
 
 int InlineParser::applyShortcutReferenceLink(int begin, int pos, const QString& linkLabel, bool isHTML) {
-  QString text{parser_->getLinkText(linkLabel)};
+  QString text{};
 
-  if (text.isEmpty()) return 0;
+  if (plain_ ? !plainLinkText(linkLabel, linkLabel, begin + 1, &text) :
+      (text = parser_->getLinkText(linkLabel)).isEmpty()) {
+    return -1;
+  }
 
-  if (!isHTML) text = linkLabel;
+  if (!isHTML && !plain_) text = linkLabel;
   const int lineEnd{line_.length()};
   int end{pos};
 	
@@ -556,17 +797,20 @@ int InlineParser::applyShortcutReferenceLink(int begin, int pos, const QString&
     }
   }
 
-  line_.replace(begin, end - begin, text);
+  replaceWithReference(InlineEvent::Link, begin, end - begin, text, linkLabel);
 
-  return text.length();
+  return begin + text.length();
 }
 
 int InlineParser::applyShortcutReferenceImage(int begin, int pos, const QString& linkLabel, bool isHTML) {
-  QString text{parser_->getImageText(linkLabel)};
+  QString text{};
 
-  if (text.isEmpty()) return 0;
+  if (plain_ ? !plainLinkText(linkLabel, linkLabel, skipWhitespace(begin + 2), &text) :
+      (text = parser_->getImageText(linkLabel)).isEmpty()) {
+    return -1;
+  }
 
-  if (!isHTML) text = linkLabel;
+  if (!isHTML && !plain_) text = linkLabel;
   const int lineEnd{line_.length()};
   int end{pos};
 	
@@ -578,63 +822,91 @@ int InlineParser::applyShortcutReferenceImage(int begin, int pos, const QString&
     }
   }
 
-  line_.replace(begin, end - begin, text);
+  replaceWithReference(InlineEvent::Image, begin, end - begin, text, linkLabel);
 
-  return text.length();
+  return begin + text.length();
 }
 
 int InlineParser::applyInlineLink(int begin, int pos, const QString& linkLabel, bool isHTML) {
-  static const QString inlineLinkTemplate1{"<a href=\"%2\">%1</a>"};
-  static const QString inlineLinkTemplate2{"<a href=\"%2\" title=\"%3\">%1</a>"};
   QString destination{};
 
-  if ((pos = findLinkDestination(pos, &destination)) == 0) return 0;
+  if ((pos = findLinkDestination(pos, &destination)) == 0) return -1;
 
   if (line_.at(pos) == ')') {
-    QString html{isHTML ?
-	inlineLinkTemplate1.arg(linkLabel, TextHandler(destination).convertToPercentEncoding()) :
-	linkLabel};
+    QString html{};
+
+    if (isHTML) {
+      html.append(QLatin1String("<a href=\""));
+      TextHandler(destination).appendPercentEncoded(&html);
+      html.append(QLatin1String("\">")).append(linkLabel).append(QLatin1String("</a>"));
+    } else {
+      html = linkLabel;
+    }
 
-    line_.replace(begin, pos - begin + 1, html);
+    replaceWithLink(InlineEvent::Link, begin, pos - begin + 1, html, destination, QString());
 
-    return html.length();
+    return begin + html.length();
   }
 
   QString title{};
   
-  if ((pos = findLinkTitle(pos, &title)) == 0) return 0;
+  if ((pos = findLinkTitle(pos, &title)) == 0) return -1;
   
-  QString html{inlineLinkTemplate2.arg(linkLabel, QString(QUrl(destination).toEncoded()), title)};
-  line_.replace(begin, pos - begin + 1, html);
+  QString html{};
+
+  if (plain_) {
+    html = linkLabel;
+  } else {
+    html.append(QLatin1String("<a href=\""));
+    TextHandler(destination).appendPercentEncoded(&html);
+    html.append(QLatin1String("\" title=\"")).append(title).append(QLatin1String("\">"));
+    html.append(linkLabel).append(QLatin1String("</a>"));
+  }
+
+  replaceWithLink(InlineEvent::Link, begin, pos - begin + 1, html, destination, title);
     
-  return html.length();
+  return begin + html.length();
 }
 
 int InlineParser::applyInlineImage(int begin, int pos, const QString& linkLabel, bool isHTML) {
-  static const QString inlineImageTemplate1{"<img src=\"%2\" alt=\"%1\" />"};
-  static const QString inlineImageTemplate2{"<img src=\"%2\" alt=\"%1\" title=\"%3\" />"};
   QString destination{};
 
-  if ((pos = findLinkDestination(pos, &destination)) == 0) return 0;
+  if ((pos = findLinkDestination(pos, &destination)) == 0) return -1;
 
   if (line_.at(pos) == ')') {
-    QString html{isHTML ?
-	inlineImageTemplate1.arg(linkLabel, TextHandler(destination).convertToPercentEncoding()) :
-	linkLabel};
+    QString html{};
 
-    line_.replace(begin, pos - begin + 1, html);
+    if (isHTML) {
+      html.append(QLatin1String("<img src=\""));
+      TextHandler(destination).appendPercentEncoded(&html);
+      html.append(QLatin1String("\" alt=\"")).append(linkLabel).append(QLatin1String("\" />"));
+    } else {
+      html = linkLabel;
+    }
 
-    return html.length();
+    replaceWithLink(InlineEvent::Image, begin, pos - begin + 1, html, destination, QString());
+
+    return begin + html.length();
   }
 
   QString title{};
   
-  if ((pos = findLinkTitle(pos, &title)) == 0) return 0;
+  if ((pos = findLinkTitle(pos, &title)) == 0) return -1;
   
-  QString html{inlineImageTemplate2.arg(linkLabel, QString(QUrl(destination).toEncoded()), title)};
-  line_.replace(begin, pos - begin + 1, html);
+  QString html{};
+
+  if (plain_) {
+    html = linkLabel;
+  } else {
+    html.append(QLatin1String("<img src=\""));
+    TextHandler(destination).appendPercentEncoded(&html);
+    html.append(QLatin1String("\" alt=\"")).append(linkLabel);
+    html.append(QLatin1String("\" title=\"")).append(title).append(QLatin1String("\" />"));
+  }
+
+  replaceWithLink(InlineEvent::Image, begin, pos - begin + 1, html, destination, title);
     
-  return html.length();
+  return begin + html.length();
 }
 
 int InlineParser::findLinkDestination(int pos, QString* destination) const {
@@ -679,7 +951,12 @@ int InlineParser::findLinkDestination(int pos, QString* destination) const {
       ++count;
     } else if (!(escape = EscapeChar::get(line_.midRef(pos))).isEmpty()) {
       pos += escape.inputLength() - 1;
-      destination->append(escape.output());
+
+      if (plain_) {
+	destination->append(escape.text());
+      } else {
+	escape.appendTo(destination);
+      }
 
       continue;
     }
@@ -720,14 +997,23 @@ int InlineParser::findLinkTitle(int pos, QString* title) const {
 	return 0;
       }
 
-      title->append(quotEntityReference);
+      if (plain_) {
+	title->append(chr);
+      } else {
+	title->append(quotEntityReference);
+      }
     } else if (chr == requiredEndChr) {
       ++pos;
       
       return (pos < line_.length() && line_.at(pos) == ')') ? pos : 0;
     } else if (!(escape = EscapeChar::get(line_.midRef(pos))).isEmpty()) {
       pos += escape.inputLength() - 1;
-      title->append(escape.output());
+
+      if (plain_) {
+	title->append(escape.text());
+      } else {
+	escape.appendTo(title);
+      }
     } else {
       title->append(chr);
     }
@@ -737,9 +1023,6 @@ int InlineParser::findLinkTitle(int pos, QString* title) const {
 }
 
 int InlineParser::replaceCodeSpan(int begin) {
-  static const QString codeTemplate{"<code>%1</code>"};
-  static const QRegularExpression re{"[ \n]+"};
-
   if (line_.at(begin) != '`') return begin;
 
   int quoteBegin{begin + 1};
@@ -765,8 +1048,23 @@ int InlineParser::replaceCodeSpan(int begin) {
 	if (++tempCnt == count) {
 	  if (++pos < end && line_.at(pos) == '`') break; // too many
 
-	  InlineParser code{line_.mid(quoteBegin, size).trimmed(), parser_};
-	  QString span{codeTemplate.arg(code.codeToHTML().replace(re," "))};
+	  QString code{collapseSpaces(line_.midRef(quoteBegin, size).trimmed())};
+
+	  if (plain_) {
+	    if (!offsets_.isEmpty()) {
+	      replacements_.append(Replacement{begin, begin + code.length(), {
+		    InlineEvent{InlineEvent::Code, InlineEvent::NoSpan, code, QString(),
+				sourceOffset(begin), sourceOffset(begin + size + 2 * count)}}});
+	    }
+
+	    replaceText(begin, size + 2 * count, code);
+
+	    return begin + code.length();
+	  }
+
+	  QString span{QLatin1String("<code>")};
+	  EntityChar::appendEscaped(&span, QStringRef(&code));
+	  span.append(QLatin1String("</code>"));
 	  line_.replace(begin, size + 2 * count, span);
 
 	  return begin + span.length();
@@ -784,9 +1082,15 @@ int InlineParser::replaceSpecialCharacter(int begin) {
   int pos{begin};
   EscapeChar escape{EscapeChar::get(line_.midRef(pos))};
 
-  if (!escape.isEmpty()) {
-    line_.replace(pos, escape.inputLength(), escape.output());
-    pos += escape.output().length();
+  if (plain_) {
+    if (!escape.isEmpty()) {
+      QString text{escape.text()};
+      replaceText(pos, escape.inputLength(), text);
+      pos += text.length();
+    }
+  } else if (!escape.isEmpty()) {
+    escape.replace(&line_, pos);
+    pos += escape.outputLength();
   } else {
     EntityChar entity{EntityChar::get(line_.at(pos))};
 
@@ -814,11 +1118,11 @@ int InlineParser::replaceWhitespace(int begin) {
 	if (chr == ' ' || chr == '\t') {
 	  if (pos + ++count < end) continue;
 	
-	  line_.chop(count);
+	  replaceText(line_.length() - count, count, QString());
 	  ++pos;
 	} else if (chr == '\n') {
-	  if (count < 2) {
-	    line_.remove(pos, count);
+	  if (count < 2 || plain_) {
+	    replaceText(pos, count, QString());
 	    ++pos;
 	  } else {
 	    line_.replace(pos, count, brTagString);
@@ -833,7 +1137,7 @@ int InlineParser::replaceWhitespace(int begin) {
 	break;
       }
     } else {
-      line_.chop(count);
+      replaceText(line_.length() - count, count, QString());
     }
   }
 
@@ -21,11 +21,27 @@
 
 #include <QStack>
 #include <QString>
+#include <QVector>
 
 #include "precedence.hpp"
 
 class Parser;
 
+// An inline element reported by InlineParser::textToEvents().  begin and end are
+// offsets in the text given to the parser, which BlockEventReader turns into
+// positions in the document; a span covers its delimiters.
+struct InlineEvent {
+  enum Type { Text, Code, EnterSpan, LeaveSpan };
+  enum SpanType { NoSpan, Emphasis, Strong, Link, Image };
+
+  Type type;
+  SpanType span;
+  QString text;  // the text or the code, or the percent-encoded destination of a link or an image
+  QString title; // of a link or an image
+  int begin;
+  int end;
+};
+
 
 class InlineParser {
 public:
@@ -34,8 +50,20 @@ public:
   QString codeToHTML();
   QString textToHTML();
   QString textToPlain();
+  QString textToPlainText();
+  QVector<InlineEvent> textToEvents();
 
 private:
+  // A code span or a link replaced in line_ from begin to end, for textToEvents()
+  struct Replacement {
+    int begin;
+    int end;
+    QVector<InlineEvent> events;
+  };
+
+  int appendSpanEvents(const Precedence& span, InlineEvent::Type type, int lastPos, int* next,
+		       QVector<InlineEvent>* events) const;
+  void appendTextEvents(int begin, int end, int* next, QVector<InlineEvent>* events) const;
   int applyAutolink(int begin, int pos);
   int applyEmailAutolink(int begin, int pos);
   int applyFullReferenceImage(int begin, int pos, const QString& description, bool isHTML);
@@ -47,22 +75,35 @@ private:
   int applyShortcutReferenceImage(int begin, int pos, const QString& linkLabel, bool isHTML);
   int applyShortcutReferenceLink(int begin, int pos, const QString& linkLabel, bool isHTML);
   bool closePrecedence(int* pos, QStack<Precedence*>* pending) const;
+  int failLink(int replacements);
   bool failToClosePrecedence(QStack<Precedence*>* stack, QStack<Precedence*>* pending) const;
   int findLinkDestination(int pos, QString* destination) const;
   int findLinkTitle(int pos, QString* title) const;
   bool findSameDelimiter(int pos, QStack<Precedence*>* pending, QStack<Precedence*>* stack) const;
   QLinkedList<Precedence> parse(bool isHTML = true);
+  bool plainLinkText(const QString& label, const QString& linkText, int textBegin, QString* text);
+  QString plainText(const QString& text, int textBegin);
   int replaceAutolink(int begin);
   int replaceCodeSpan(int begin);
   int replaceImage(int begin, bool isHTML);
   int replaceLink(int begin, bool isHTML);
   int replaceSpecialCharacter(int pos);
   int replaceSquareBrackets(int begin);
+  void replaceText(int begin, int length, const QString& text);
   int replaceWhitespace(int begin);
+  void replaceWithLink(InlineEvent::SpanType type, int begin, int length, const QString& text,
+		       const QString& destination, const QString& title);
+  void replaceWithReference(InlineEvent::SpanType type, int begin, int length, const QString& text,
+			    const QString& label);
   int skipEmphasis(int pos, QLinkedList<Precedence>* split, QStack<Precedence*>* pending) const;
   int skipTagName(int begin) const;
   int skipWhitespace(int pos) const;
+  int sourceOffset(int pos) const;
 
   QString line_;
   const Parser* parser_;
+  bool plain_; // for textToPlainText(), which leaves out all markup
+  QVector<int> offsets_; // for textToEvents(), the offset in the text of each character of line_
+  QVector<Replacement> replacements_;
+  QVector<InlineEvent> linkEvents_; // the events of the text of the link being replaced
 };
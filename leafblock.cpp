@@ -19,20 +19,40 @@
 
 #include "leafblock.hpp"
 
-#include <unordered_map>
+#include "character.hpp"
 #include "linehandler.hpp"
 #include "inlineparser.hpp"
 #include "parser.hpp"
 #include "texthandler.hpp"
 
 
+namespace {
+  // The size of the tags around the text of a leaf block, at most
+  const int TAG_SIZE{32};
+}
+
 ////////////////
 // Leaf Block //
 ////////////////
 
-LeafBlock::LeafBlock(ContainerBlock* parent, const QString& text)
+LeafBlock::LeafBlock(ContainerBlock* parent, bool linebreakAtEOL)
   : Block(parent),
-    text_(text)
+    text_(),
+    lines_(),
+    source_(),
+    skipped_(0),
+    linebreakAtEOL_(linebreakAtEOL),
+    lastLine_(firstLine())
+{}
+
+LeafBlock::LeafBlock(ContainerBlock* parent, const LineSpan& line)
+  : Block(parent),
+    text_(),
+    lines_{line},
+    source_(),
+    skipped_(0),
+    linebreakAtEOL_(false),
+    lastLine_(firstLine())
 {}
 
 LeafBlock::~LeafBlock() {
@@ -47,11 +67,141 @@ bool LeafBlock::appendParagraphText(const LineHandler& /* lineHandler */) {
 }
 
 void LeafBlock::appendLine(const LineHandler& lineHandler) {
-  text_.append(lineHandler.putLinebreakAtBOL());
+  lines_.append(lineHandler.span());
+  lastLine_ = parent()->parser()->lineNumber();
+}
+
+// The text as it is, as for code, without the linebreak at the end
+void LeafBlock::appendPlainText(QString* output) const {
+  QString text{this->text()};
+
+  if (text.endsWith('\n')) text.chop(1);
+
+  output->append(text);
+}
+
+// The size of the source and the tags; escapes and inline markup may differ
+int LeafBlock::estimateHTMLSize() const {
+  return textLength() + TAG_SIZE;
+}
+
+int LeafBlock::lastLine() const {
+  return lastLine_;
+}
+
+QString LeafBlock::literal() const {
+  return text();
+}
+
+// The spaces of a partially consumed tab are at the tab, and each linebreak is
+// at the end of its line
+QVector<int> LeafBlock::sourcePositions() const {
+  const QVector<LineSpan>& lines{lines_.isEmpty() ? source_ : lines_};
+  QVector<int> positions{};
+
+  if (lines.isEmpty()) return positions;
+
+  positions.reserve(textLength() + skipped_);
+
+  for (const LineSpan& line : lines) {
+    for (int column{0}; column < line.offset; ++column) {
+      positions.append(line.text.position() - 1);
+    }
+
+    for (int i{0}; i <= line.text.length(); ++i) {
+      positions.append(line.text.position() + i);
+    }
+  }
+
+  if (lines_.isEmpty()) {
+    positions.remove(0, skipped_);
+    positions.resize(text_.length() + 1);
+  } else if (linebreakAtEOL_) {
+    positions.append(positions.last());
+  }
+
+  return positions;
+}
+
+// Same as escaping text(), without putting the lines together first
+void LeafBlock::appendEscapedText(QString* output) const {
+  EntityChar::appendEscaped(output, QStringRef(&text_));
+
+  for (int i{0}; i < lines_.size(); ++i) {
+    const LineSpan& line{lines_.at(i)};
+
+    if (!linebreakAtEOL_ && (i > 0 || !text_.isEmpty())) output->append('\n');
+
+    for (int column{0}; column < line.offset; ++column) {
+      output->append(' ');
+    }
+
+    EntityChar::appendEscaped(output, line.text);
+
+    if (linebreakAtEOL_) output->append('\n');
+  }
+}
+
+void LeafBlock::appendLines(const QVector<LineSpan>& lines) {
+  lines_ += lines;
+}
+
+const QVector<LineSpan>& LeafBlock::lines() const {
+  return lines_;
+}
+
+void LeafBlock::setLastLine(int line) {
+  lastLine_ = line;
+}
+
+// Replaces the lines, or the text put together from them, with text which
+// leaves out the first skipped characters of it.  The lines are kept for
+// sourcePositions().
+void LeafBlock::setText(const QString& text, int skipped) {
+  text_ = text;
+
+  if (lines_.isEmpty()) {
+    skipped_ += skipped;
+  } else {
+    source_.swap(lines_);
+    lines_.clear();
+    skipped_ = skipped;
+  }
+}
+
+QString LeafBlock::text() const {
+  if (lines_.isEmpty()) return text_;
+
+  QString text{};
+  text.reserve(textLength());
+  text.append(text_);
+
+  for (int i{0}; i < lines_.size(); ++i) {
+    const LineSpan& line{lines_.at(i)};
+
+    if (!linebreakAtEOL_ && (i > 0 || !text_.isEmpty())) text.append('\n');
+
+    for (int column{0}; column < line.offset; ++column) {
+      text.append(' ');
+    }
+
+    text.append(line.text);
+
+    if (linebreakAtEOL_) text.append('\n');
+  }
+
+  return text;
 }
 
-void LeafBlock::appendLine2(const LineHandler& lineHandler) {
-  text_.append(lineHandler.putLinebreakAtEOL());
+// The length of text(), without putting it together
+int LeafBlock::textLength() const {
+  int size{text_.length()};
+
+  for (const LineSpan& line : lines_) {
+    size += line.offset + line.text.length() + 1;
+  }
+
+  return size;
 }
 
 
@@ -60,7 +210,7 @@ void LeafBlock::appendLine2(const LineHandler& lineHandler) {
 /////////////////////
 
 ParagraphBlock::ParagraphBlock(ContainerBlock* parent, const LineHandler& lineHandler)
-  : LeafBlock(parent, lineHandler.currentText())
+  : LeafBlock(parent, lineHandler.span())
 {}
 
 ParagraphBlock::~ParagraphBlock() {
@@ -88,15 +238,9 @@ bool ParagraphBlock::appendIndentedText(LineHandler* lineHandler) {
 
 HeadingBlock* ParagraphBlock::convertToSetextHeading(const LineHandler& lineHandler) {
   if (writable()) {
-    std::unordered_map<char, int> markdownList = {{'=', 1}, {'-', 2}};
-    QString text{lineHandler.trimmed()};
-    int length{text.length()};
-    
-    for (auto markdown : markdownList) {
-      if (text.count(markdown.first) == length) {
-	return new HeadingBlock(parent(), text_.trimmed(), markdown.second);
-      }
-    }
+    int level{lineHandler.setextHeadingLevel()};
+
+    if (level > 0) return new HeadingBlock(parent(), lines(), level);
   }
 
   return nullptr;
@@ -110,28 +254,35 @@ void ParagraphBlock::handleBlankLine(const LineHandler& /* lineHandler */) {
 void ParagraphBlock::close() {
   if (!writable()) return;
   
-  TextHandler temp{text_};
-  int pos{0};
-  QString label{temp.findLinkLabel(&pos, ':')};
+  // the text is put together only once, for link reference definitions and html()
+  QString text{this->text()};
+  setText(text, 0);
+  TextHandler temp{text};
+  int offset{0}; // the end of the definitions so far
+
+  while (offset < text.length()) {
+    int pos{offset};
+    QString label{temp.findLinkLabel(&pos, ':')};
+
+    if (label.isEmpty()) break;
 
-  if (!label.isEmpty()) {
     QString reference{temp.findLinkReference(&pos)};
 
-    if (!reference.isEmpty()) {
-      bool ok;
-      QString title{temp.findLinkTitle(&pos, &ok)};
+    if (reference.isEmpty()) break;
 
-      if (ok) {
-	parent()->parser()->defineLink(label, reference, title);
-	text_ = temp.rest(pos);
+    bool ok;
+    QString title{temp.findLinkTitle(&pos, &ok)};
 
-	if (text_.isEmpty()) {
-	  parent()->removeLast();
-	} else {
-	  close();
-	}
-      }
-    }
+    if (!ok) break;
+
+    parent()->parser()->defineLink(label, reference, title);
+    offset = pos;
+  }
+
+  if (offset >= text.length() && offset > 0) {
+    parent()->removeLast();
+  } else if (offset > 0) {
+    setText(temp.rest(offset), offset);
   }
   
   disable();
@@ -141,7 +292,15 @@ QString ParagraphBlock::html() const {
   static const QString NO_TAG{"%1"};
   static const QString WITH_TAG{"<p>%1</p>"};
   
-  return (parent()->hasBlankline() ? WITH_TAG : NO_TAG).arg(InlineParser(text_, parent()->parser()).textToHTML());
+  return (parent()->hasBlankline() ? WITH_TAG : NO_TAG).arg(InlineParser(text(), parent()->parser()).textToHTML());
+}
+
+void ParagraphBlock::appendPlainText(QString* output) const {
+  output->append(InlineParser(text(), parent()->parser()).textToPlainText());
+}
+
+Block::Type ParagraphBlock::type() const {
+  return Paragraph;
 }
 
 /////////////////////////
@@ -151,7 +310,7 @@ QString ParagraphBlock::html() const {
 const int IndentedCodeBlock::INDENT_SIZE = 4;
 
 IndentedCodeBlock::IndentedCodeBlock(ContainerBlock* parent, const LineHandler& lineHandler)
-  : LeafBlock(parent, lineHandler.currentText()),
+  : LeafBlock(parent, lineHandler.span()),
     pending_()
 {}
 
@@ -161,7 +320,7 @@ IndentedCodeBlock::~IndentedCodeBlock() {
 bool IndentedCodeBlock::appendIndentedText(LineHandler* lineHandler) {
   if (!writable()) return false;
 
-  text_.append(pending_);
+  appendLines(pending_);
   pending_.clear();
   appendLine(*lineHandler);
 
@@ -171,17 +330,24 @@ bool IndentedCodeBlock::appendIndentedText(LineHandler* lineHandler) {
 void IndentedCodeBlock::handleBlankLine(const LineHandler& lineHandler) {
   int indent{INDENT_SIZE + parent()->indent()};
   LineHandler removed{lineHandler.removeIndent(indent)};
-  pending_.append('\n');
-
-  if (removed.indent() >= indent) {
-    pending_.append(removed.currentText());
-  }
+  pending_.append(removed.indent() >= indent ? removed.span() : LineSpan{QStringRef(), 0});
 };
 
+void IndentedCodeBlock::appendHTML(QString* output) const {
+  output->append(QLatin1String("<pre><code>"));
+  appendEscapedText(output);
+  output->append(QLatin1String("\n</code></pre>"));
+}
+
 QString IndentedCodeBlock::html() const {
-  static const QString indentedCodeTemplate{"<pre><code>%1\n</code></pre>"};
+  QString html{};
+  appendHTML(&html);
+
+  return html;
+}
 
-  return indentedCodeTemplate.arg(InlineParser(text_, parent()->parser()).codeToHTML());
+Block::Type IndentedCodeBlock::type() const {
+  return IndentedCode;
 }
 
 
@@ -190,7 +356,7 @@ QString IndentedCodeBlock::html() const {
 ///////////////////////
 
 FencedCodeBlock::FencedCodeBlock(ContainerBlock* parent, QChar fence, int count, const QString& rest, int indent)
-  : LeafBlock(parent, ""),
+  : LeafBlock(parent, true),
     fence_(fence),
     count_(count),
     rest_(rest),
@@ -202,7 +368,7 @@ FencedCodeBlock::~FencedCodeBlock() {
 
 void FencedCodeBlock::handleBlankLine(const LineHandler& lineHandler) {
   if (writable()) {
-    appendLine2(lineHandler.removeIndent(indent_));
+    appendLine(lineHandler.removeIndent(indent_));
   } else {
     parent()->setHasBlankline(true);
   }
@@ -212,6 +378,7 @@ bool FencedCodeBlock::toggleFencedCodeBlock(QChar fenceChar, int count, const Li
   if (writable()) {
     if (count < count_ || fenceChar != fence_ || !rest.isBlank()) return false;
 
+    setLastLine(parent()->parser()->lineNumber()); // the closing fence
     disable();
   } else {
     parent()->appendLeafBlock(new FencedCodeBlock(parent(), fenceChar, count, rest.firstWord().toString(), indent));
@@ -223,7 +390,7 @@ bool FencedCodeBlock::toggleFencedCodeBlock(QChar fenceChar, int count, const Li
 bool FencedCodeBlock::appendFencedCodeText(const LineHandler& lineHandler) {
   if (!writable()) return false;
   
-  appendLine2(lineHandler.removeIndent(indent_));
+  appendLine(lineHandler.removeIndent(indent_));
   
   return true;
 }
@@ -233,20 +400,33 @@ bool FencedCodeBlock::appendIndentedText(LineHandler* lineHandler) {
     return false;
   }
   
-  appendLine2(lineHandler->removeIndent(indent_));
+  appendLine(lineHandler->removeIndent(indent_));
   
   return true;
 }
 
+void FencedCodeBlock::appendHTML(QString* output) const {
+  if (rest_.isEmpty()) {
+    output->append(QLatin1String("<pre><code>"));
+  } else {
+    output->append(QLatin1String("<pre><code class=\"language-"));
+    output->append(InlineParser(rest_, parent()->parser()).textToHTML());
+    output->append(QLatin1String("\">"));
+  }
+
+  appendEscapedText(output);
+  output->append(QLatin1String("</code></pre>"));
+}
+
 QString FencedCodeBlock::html() const {
-  static const QString FencedCodeTemplate{"<pre><code>%1</code></pre>"};
-  static const QString FencedCodeWithLanguageTemplate{"<pre><code class=\"language-%2\">%1</code></pre>"};
-  const Parser* parser{parent()->parser()};
-  QString temp{InlineParser(text_, parser).codeToHTML()};
+  QString html{};
+  appendHTML(&html);
+
+  return html;
+}
 
-  return rest_.isEmpty() ?
-    FencedCodeTemplate.arg(temp) :
-    FencedCodeWithLanguageTemplate.arg(temp, InlineParser(rest_, parser).textToHTML());
+Block::Type FencedCodeBlock::type() const {
+  return FencedCode;
 }
 
 
@@ -254,14 +434,22 @@ QString FencedCodeBlock::html() const {
 // Heading block //
 ///////////////////
 
-HeadingBlock::HeadingBlock(ContainerBlock* parent, const QString& line, int level)
-  : LeafBlock(parent, line),
-    tag_(QString("<h%1>%2</h%1>").arg(level))
-{}
+HeadingBlock::HeadingBlock(ContainerBlock* parent, const QVector<LineSpan>& lines, int level)
+  : LeafBlock(parent, false),
+    level_(level)
+{
+  appendLines(lines);
+  QString text{this->text()};
+  int skipped{0};
+
+  while (skipped < text.length() && text.at(skipped).isSpace()) ++skipped;
+
+  setText(text.trimmed(), skipped);
+}
 
 HeadingBlock::HeadingBlock(ContainerBlock* parent, const LineHandler& lineHandler, int level)
-  : LeafBlock(parent, lineHandler.trimmed()),
-    tag_(QString("<h%1>%2</h%1>").arg(level))
+  : LeafBlock(parent, lineHandler.trimmedSpan()),
+    level_(level)
 {}
 
 HeadingBlock::~HeadingBlock() {
@@ -272,7 +460,29 @@ void HeadingBlock::handleBlankLine(const LineHandler& /* lineHandler */) {
 }
 
 QString HeadingBlock::html() const {
-  return tag_.arg(InlineParser(text_, parent()->parser()).textToHTML());
+  const QChar digit('0' + level_);
+  QString html{QLatin1String("<h")};
+  html.append(digit).append('>');
+  html.append(InlineParser(text(), parent()->parser()).textToHTML());
+  html.append(QLatin1String("</h")).append(digit).append('>');
+
+  return html;
+}
+
+int HeadingBlock::level() const {
+  return level_;
+}
+
+void HeadingBlock::appendOutline(QVector<OutlineItem>* outline) const {
+  outline->append(OutlineItem{level_, InlineParser(text(), parent()->parser()).textToHTML(), firstLine()});
+}
+
+void HeadingBlock::appendPlainText(QString* output) const {
+  output->append(InlineParser(text(), parent()->parser()).textToPlainText());
+}
+
+Block::Type HeadingBlock::type() const {
+  return Heading;
 }
 
 ////////////////////
@@ -280,7 +490,7 @@ QString HeadingBlock::html() const {
 ////////////////////
 
 ThematicBreak::ThematicBreak(ContainerBlock* parent)
-  : LeafBlock(parent, "")
+  : LeafBlock(parent, false)
 {
   disable();
 }
@@ -292,13 +502,17 @@ QString ThematicBreak::html() const {
   return "<hr />";
 }
 
+Block::Type ThematicBreak::type() const {
+  return Break;
+}
+
 
 ////////////////
 // HTML Block //
 ////////////////
 
 HTMLBlock::HTMLBlock(ContainerBlock* parent, const LineHandler& lineHandler)
-  : LeafBlock(parent, lineHandler.currentText())
+  : LeafBlock(parent, lineHandler.span())
 {}
 
 HTMLBlock::~HTMLBlock() {
@@ -320,22 +534,24 @@ bool HTMLBlock::appendHTMLBlockText(const LineHandler& lineHandler) {
 
 HeadingBlock* HTMLBlock::convertToSetextHeading(const LineHandler& lineHandler) {
   if (writable()) {
-    std::unordered_map<char, int> markdownList = {{'=', 1}, {'-', 2}};
-    QString text{lineHandler.trimmed()};
-    int length = text.length();
-    
-    for (auto markdown : markdownList) {
-      if (text.count(markdown.first) == length) {
-	return new HeadingBlock(parent(), text_.trimmed(), markdown.second);
-      }
-    }
+    int level{lineHandler.setextHeadingLevel()};
+
+    if (level > 0) return new HeadingBlock(parent(), lines(), level);
   }
 
   return nullptr;
 }
 
 QString HTMLBlock::html() const {
-  return text_;
+  return text();
+}
+
+void HTMLBlock::appendPlainText(QString* /* output */) const {
+  return; // markup only
+}
+
+Block::Type HTMLBlock::type() const {
+  return HTML;
 }
 
 bool HTMLBlock::closeHTMLBlock(const LineHandler& /* lineHandler */) {
@@ -351,9 +567,9 @@ void HTMLBlock::handleBlankLine(const LineHandler& /* lineHandler */) {
 // HTML Block with close tag //
 ///////////////////////////////
 
-HTMLBlockWithCloseTag::HTMLBlockWithCloseTag(ContainerBlock* parent, const LineHandler& lineHandler, const QRegularExpression* closeTag)
+HTMLBlockWithCloseTag::HTMLBlockWithCloseTag(ContainerBlock* parent, const LineHandler& lineHandler, int type)
   : HTMLBlock(parent, lineHandler),
-    closeTag_(closeTag)
+    type_(type)
 {}
 
 HTMLBlockWithCloseTag::~HTMLBlockWithCloseTag() {
@@ -361,7 +577,7 @@ HTMLBlockWithCloseTag::~HTMLBlockWithCloseTag() {
 
 bool HTMLBlockWithCloseTag::closeHTMLBlock(const LineHandler& lineHandler) {
   // for type 1
-  if (!lineHandler.matchHTMLCloseTag(*closeTag_)) return false;
+  if (!lineHandler.matchHTMLCloseTag(type_)) return false;
 
   appendHTMLBlockText(lineHandler);
   disable();
@@ -19,24 +19,47 @@
 
 #pragma once
 
+#include <QVector>
 #include "block.hpp"
+#include "linehandler.hpp"
 
 
+// Leaf blocks keep their lines as spans of the input, and put them together
+// only when the text is needed.  Each line is preceded by a linebreak except
+// the first one, or followed by a linebreak (linebreakAtEOL).
 class LeafBlock : public Block {
 public:
   LeafBlock() = delete;
-  LeafBlock(ContainerBlock* parent, const QString& text);
+  LeafBlock(ContainerBlock* parent, bool linebreakAtEOL);
+  LeafBlock(ContainerBlock* parent, const LineSpan& line);
   virtual ~LeafBlock() override;
 
   virtual bool appendIndentedText(LineHandler* lineHandler) override;
   virtual bool appendParagraphText(const LineHandler& lineHandler) override;
 
   void appendLine(const LineHandler& lineHandler) override;
-
-  void appendLine2(const LineHandler& lineHandler);
+  void appendPlainText(QString* output) const override;
+  int estimateHTMLSize() const override;
+  int lastLine() const override;
+  QString literal() const override;
+  QVector<int> sourcePositions() const override;
 
 protected:
+  void appendEscapedText(QString* output) const;
+  void appendLines(const QVector<LineSpan>& lines);
+  const QVector<LineSpan>& lines() const;
+  void setLastLine(int line);
+  void setText(const QString& text, int skipped);
+  QString text() const;
+  int textLength() const;
+
+private:
   QString text_;
+  QVector<LineSpan> lines_;
+  QVector<LineSpan> source_; // the lines which text_ was put together from
+  int skipped_;              // the characters of source_ left out before text_
+  bool linebreakAtEOL_;
+  int lastLine_;
 };
 
 class ParagraphBlock : public LeafBlock {
@@ -47,11 +70,13 @@ public:
 
   bool appendIndentedText(LineHandler* lineHandler) override;
   bool appendParagraphText(const LineHandler& lineHandler) override;
+  void appendPlainText(QString* output) const override;
   void close() override;
   HeadingBlock* convertToSetextHeading(const LineHandler& lineHandler) override;
   void handleBlankLine(const LineHandler& lineHandler) override;
   QString html() const override;
   bool isParagraph() const override;
+  Type type() const override;
 };
 
 class IndentedCodeBlock : public LeafBlock {
@@ -62,12 +87,14 @@ public:
   IndentedCodeBlock(ContainerBlock* parent, const LineHandler& lineHandler);
   ~IndentedCodeBlock() override;
 
+  void appendHTML(QString* output) const override;
   bool appendIndentedText(LineHandler* lineHandler) override;
   void handleBlankLine(const LineHandler& lineHandler) override;
   QString html() const override;
+  Type type() const override;
 
 private:
-  QString pending_;
+  QVector<LineSpan> pending_;
 };
 
 class FencedCodeBlock : public LeafBlock {
@@ -77,10 +104,12 @@ public:
   ~FencedCodeBlock() override;
 
   bool appendFencedCodeText(const LineHandler& lineHandler) override;
+  void appendHTML(QString* output) const override;
   bool appendIndentedText(LineHandler* lineHandler) override;
   void handleBlankLine(const LineHandler& lineHandler) override;
   QString html() const override;
   bool toggleFencedCodeBlock(QChar fenceChar, int count, const LineHandler& rest, int indent) override;
+  Type type() const override;
 
 private:
   QChar fence_;
@@ -92,15 +121,20 @@ private:
 class HeadingBlock : public LeafBlock {
 public:
   HeadingBlock() = delete;
-  HeadingBlock(ContainerBlock* parent, const QString& line, int level);
+  HeadingBlock(ContainerBlock* parent, const QVector<LineSpan>& lines, int level);
   HeadingBlock(ContainerBlock* parent, const LineHandler& lineHandler, int level);
   ~HeadingBlock() override;
 
+  void appendOutline(QVector<OutlineItem>* outline) const override;
+  void appendPlainText(QString* output) const override;
   void handleBlankLine(const LineHandler& lineHandler) override;
   QString html() const override;
+  Type type() const override;
+
+  int level() const;
 
 private:
-  QString tag_;
+  int level_;
 };
 
 class ThematicBreak : public LeafBlock {
@@ -110,6 +144,7 @@ public:
   ~ThematicBreak() override;
 
   QString html() const override;
+  Type type() const override;
 };
 
 class HTMLBlock : public LeafBlock {
@@ -120,21 +155,23 @@ public:
 
   bool appendHTMLBlockText(const LineHandler& lineHandler) override;
   bool appendIndentedText(LineHandler* lineHandler) override;
+  void appendPlainText(QString* output) const override;
   bool closeHTMLBlock(const LineHandler& lineHandler) override;
   HeadingBlock* convertToSetextHeading(const LineHandler& lineHandler) override;
   void handleBlankLine(const LineHandler& lineHandler) override;
   QString html() const override;
+  Type type() const override;
 };
 
 class HTMLBlockWithCloseTag : public HTMLBlock {
 public:
   HTMLBlockWithCloseTag() = delete;
-  HTMLBlockWithCloseTag(ContainerBlock* parent, const LineHandler& lineHandler, const QRegularExpression* closeTag);
+  HTMLBlockWithCloseTag(ContainerBlock* parent, const LineHandler& lineHandler, int type);
   ~HTMLBlockWithCloseTag() override;
 
   bool closeHTMLBlock(const LineHandler& lineHandler) override;
   void handleBlankLine(const LineHandler& lineHandler) override;
 
 private:
-  const QRegularExpression* closeTag_;
+  int type_;
 };
@@ -0,0 +1,47 @@
+TEMPLATE = lib
+TARGET = mdparser
+INCLUDEPATH += .
+DEFINES += MDPARSER_BUILD
+
+mdparser_shared {
+    DEFINES += MDPARSER_SHARED
+} else {
+    CONFIG += staticlib
+}
+
+# Input
+HEADERS += block.hpp \
+           blockeventreader.hpp \
+           character.hpp \
+           containerblock.hpp \
+           documenthandler.hpp \
+           htmltag.hpp \
+           inlineparser.hpp \
+           leafblock.hpp \
+           linehandler.hpp \
+           lineindex.hpp \
+           mdparser.h \
+           memstats.hpp \
+           parser.hpp \
+           precedence.hpp \
+           texthandler.hpp
+
+SOURCES += block.cpp \
+           blockeventreader.cpp \
+           character.cpp \
+           containerblock.cpp \
+           documenthandler.cpp \
+           htmltag.cpp \
+           inlineparser.cpp \
+           leafblock.cpp \
+           linehandler.cpp \
+           lineindex.cpp \
+           mdparser.cpp \
+           memstats.cpp \
+           parser.cpp \
+           precedence.cpp \
+           texthandler.cpp
+
+CONFIG += c++11 \
+    thread \
+    debug
@@ -19,10 +19,40 @@
 
 #include "linehandler.hpp"
 
-#include <QRegularExpression>
+#include "htmltag.hpp"
+#include "lineindex.hpp"
 #include "texthandler.hpp"
 
 
+namespace {
+  constexpr int ALL{LineHandler::AnyBlockStart};
+  constexpr int HTM{LineHandler::HTMLBlockStart};
+  constexpr int FEN{LineHandler::FencedCodeStart};
+  constexpr int SET{LineHandler::SetextUnderline};
+  constexpr int THB{LineHandler::ThematicBreakStart};
+  constexpr int HDG{LineHandler::HeadingStart};
+  constexpr int BQT{LineHandler::BlockQuoteStart};
+  constexpr int ORD{LineHandler::OrderedListStart};
+  constexpr int STR{LineHandler::ThematicBreakStart | LineHandler::BulletListStart}; // '*'
+  constexpr int PLS{LineHandler::BulletListStart}; // '+'
+  constexpr int DSH{LineHandler::SetextUnderline | LineHandler::ThematicBreakStart | LineHandler::BulletListStart}; // '-'
+
+  // The block starts possible for the first non-space ASCII character of a
+  // line.  Control characters may be trimmed as spaces, so nothing is ruled
+  // out for them.
+  constexpr int blockStartTable[128]{
+    ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL,
+    ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL, ALL,
+    ALL, 0,   0,   HDG, 0,   0,   0,   0,   0,   0,   STR, PLS, 0,   DSH, 0,   0,   //  !"#$%&'()*+,-./
+    ORD, ORD, ORD, ORD, ORD, ORD, ORD, ORD, ORD, ORD, 0,   0,   HTM, SET, BQT, 0,   // 0123456789:;<=>?
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // @ABCDEFGHIJKLMNO
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   THB, // PQRSTUVWXYZ[\]^_
+    FEN, 0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // `abcdefghijklmno
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   FEN, 0,   // pqrstuvwxyz{|}~
+  };
+}
+
+
 const int LineHandler::TAB_SIZE = 4;
 
 LineHandler::LineHandler(const QStringRef& line)
@@ -31,7 +61,20 @@ LineHandler::LineHandler(const QStringRef& line)
     logicalPosition_(0),
     offset_(0),
     depth_(0),
-    indent_(0) {
+    indent_(0),
+    index_(nullptr),
+    number_(0) {
+}
+
+LineHandler::LineHandler(const LineIndex& index, int number)
+  : line_(index.line(number)),
+    physicalPosition_(0),
+    logicalPosition_(0),
+    offset_(0),
+    depth_(0),
+    indent_(0),
+    index_(&index),
+    number_(number) {
 }
 
 LineHandler::LineHandler(const QStringRef& line, int physicalPosition, int logicalPosition, int offset, int depth, int indent)
@@ -40,48 +83,47 @@ LineHandler::LineHandler(const QStringRef& line, int physicalPosition, int logic
     logicalPosition_(logicalPosition),
     offset_(offset),
     depth_(depth),
-    indent_(indent) {
+    indent_(indent),
+    index_(nullptr),
+    number_(0) {
 }
 
 int LineHandler::indexOf(QChar chr) const {
   return line_.indexOf(chr, physicalPosition_);
 }
 
-QString LineHandler::currentText() const {
-  if (offset_ == 0) {
-    return currentTextRef().toString();
-  }
-
-  QString temp{offset_, QChar(' ')};
-  currentTextRef().appendTo(&temp);
-
-  return temp;
-
-}
-
 QStringRef LineHandler::currentTextRef() const {
   return physicalPosition_ < line_.length() ?
     line_.mid(physicalPosition_) : QStringRef();
 }
 
-QString LineHandler::putLinebreakAtBOL() const {
-  QString temp{"\n    "};
-  temp.truncate(offset_ + 1);
-  currentTextRef().appendTo(&temp);
+// Returns the column of the character at physical, from the index if any.
+int LineHandler::column(int physical) const {
+  if (index_) return index_->column(number_, physical);
 
-  return temp;
-}
+  int column{0};
 
-QString LineHandler::putLinebreakAtEOL() const {
-  if (offset_ == 0) {
-    return currentTextRef().toString() + QChar('\n');
+  for (int pos{0}; pos < physical; ++pos) {
+    column += line_.at(pos) == '\t' ? TAB_SIZE - column % TAB_SIZE : 1;
   }
-  
-  QString temp{offset_, QChar(' ')};
-  currentTextRef().appendTo(&temp);
-  temp += QChar('\n');
 
-  return temp;
+  return column;
+}
+
+// Returns the columns which the tab at physical takes up to the next tab stop
+int LineHandler::tabWidth(int physical) const {
+  return column(physical + 1) - column(physical);
+}
+
+// Whether only spaces and tabs are before the first other character of the
+// line, as recorded in the index; removeLastSequence() may have cut it.
+bool LineHandler::isAtIndexedHead() const {
+  return index_ && physicalPosition_ <= index_->textOffset(number_) &&
+    (index_->textOffset(number_) < line_.length() || index_->isBlank(number_));
+}
+
+LineSpan LineHandler::span() const {
+  return LineSpan{currentTextRef(), offset_};
 }
 
 int LineHandler::position() const {
@@ -96,7 +138,28 @@ int LineHandler::indent() const {
   return indent_;
 }
 
+// Returns the BlockStart flags of the blocks which the rest of the line may
+// start; the others need not be tried.
+int LineHandler::blockStarts() const {
+  if (isAtIndexedHead()) return index_->blockStarts(number_);
+
+  int pos{physicalPosition_};
+  int length{line_.length()};
+
+  while (pos < length && (line_.at(pos) == ' ' || line_.at(pos) == '\t')) ++pos;
+
+  return pos < length ? blockStartsOf(line_.at(pos)) : AnyBlockStart;
+}
+
+int LineHandler::blockStartsOf(QChar chr) {
+  if (chr.unicode() < 128) return blockStartTable[chr.unicode()];
+
+  return chr.isSpace() ? AnyBlockStart : chr.isDigit() ? OrderedListStart : 0;
+}
+
 int LineHandler::countIndent() const {
+  if (index_) return index_->indent(number_);
+
   int count{0};
   int length{line_.length()};
 
@@ -104,7 +167,7 @@ int LineHandler::countIndent() const {
     QChar chr{line_.at(pos)};
 
     if (chr == '\t') {
-      count += TAB_SIZE - pos % TAB_SIZE;
+      count += TAB_SIZE - count % TAB_SIZE;
     } else if (chr == ' ') {
       ++count;
     } else {
@@ -121,7 +184,11 @@ LineHandler LineHandler::removeIndent(int indent) const {
   }
   
   if (indent < indent_) {
-    return LineHandler(line_).removeIndent(indent);
+    LineHandler head{line_};
+    head.index_ = index_;
+    head.number_ = number_;
+
+    return head.removeIndent(indent);
   }
 
   int pos{physicalPosition_};
@@ -140,7 +207,7 @@ LineHandler LineHandler::removeIndent(int indent) const {
     QChar chr{line_.at(pos)};
     
     if (chr == '\t') {
-      logical += TAB_SIZE - logical % TAB_SIZE;
+      logical += tabWidth(pos);
     } else if (chr == ' ') {
       ++logical;
     } else {
@@ -149,8 +216,11 @@ LineHandler LineHandler::removeIndent(int indent) const {
   }
 
   int diff{logical - logicalPosition_};
-  
-  return LineHandler(line_, pos, logical, offset, depth_, diff + indent_);
+  LineHandler removed{line_, pos, logical, offset, depth_, diff + indent_};
+  removed.index_ = index_;
+  removed.number_ = number_;
+
+  return removed;
 }
 
 void LineHandler::removeLastSequence(QChar chr) {
@@ -188,86 +258,44 @@ void LineHandler::removeLastSequence(QChar chr) {
 }
 
 void LineHandler::skipWhitespace() {
+  if (index_ && physicalPosition_ == 0 && logicalPosition_ == 0 && offset_ == 0) {
+    physicalPosition_ = index_->textOffset(number_);
+    logicalPosition_ = index_->indent(number_);
+    indent_ += logicalPosition_;
+
+    return;
+  }
+
   int physical{physicalPosition_};
-  int logical{logicalPosition_};
   int length{line_.length()};
-  int indent{indent_};
 
-  for (; physical < length; ++physical) {
-    QChar chr{line_.at(physical)};
-    if (chr == '\t') {
-      int diff = TAB_SIZE - logical % TAB_SIZE;
-      logical += diff;
-      indent += diff;
-    } else if (chr == ' ') {
-      ++logical;
-      ++indent;
-    } else {
-      break;
-    }
-  }
+  while (physical < length && (line_.at(physical) == ' ' || line_.at(physical) == '\t')) ++physical;
 
+  if (physical == physicalPosition_) return;
+
+  // the rest of a partially consumed tab is skipped too
+  int logical{logicalPosition_ + offset_ + column(physical) - column(physicalPosition_)};
+  indent_ += logical - logicalPosition_;
   physicalPosition_ = physical;
   logicalPosition_ = logical;
-  indent_ = indent;
+  offset_ = 0;
 }
 
-QString LineHandler::trimmed() const {
-  return line_.mid(physicalPosition_).trimmed().toString();
+LineSpan LineHandler::trimmedSpan() const {
+  return LineSpan{line_.mid(physicalPosition_).trimmed(), 0};
 }
 
-QRegularExpressionMatch LineHandler::matchHTMLTag() const {
-  static const QRegularExpression re("\\A\\s*(<[a-zA-Z][a-zA-Z0-9]*\\s*/?>|<[a-zA-Z][a-zA-Z0-9]*\\s[^<>]*/?>|</[a-zA-Z][a-zA-Z0-9]*>)(.*)\\z", QRegularExpression::CaseInsensitiveOption);
-  
-  return re.match(line_, physicalPosition_);
+int LineHandler::matchHTMLOpenTag() const {
+  // the start conditions of type 1-5 are checked from the beginning of a line
+  return physicalPosition_ > 0 ? 0 : HTMLTag::findOpenTag(line_);
 }
 
-bool LineHandler::matchHTMLOpenTag(const QRegularExpression& tag) const {
-  return tag.match(line_, physicalPosition_).hasMatch();
+bool LineHandler::matchHTMLCloseTag(int type) const {
+  return HTMLTag::hasCloseTag(type, line_.mid(physicalPosition_));
 }
 
-bool LineHandler::matchHTMLCloseTag(const QRegularExpression& tag) const {
-  return matchHTMLOpenTag(tag);
-}
-
-bool LineHandler::matchHTMLTag(const QStringList& tagList) const {
-  int pos{physicalPosition_};
-  int length{line_.length()};
-
-  while (pos < length - 3) {
-    if (line_.at(pos).isSpace()) {
-      ++pos;
-    } else {
-      if (line_.at(pos++) != '<') return false;
-
-      if (line_.at(pos) == '/') ++pos;
-      
-      QStringRef temp{line_.mid(pos)};
-      length -= pos;
-      
-      for (auto tagName : tagList) {
-	pos = tagName.length();
-	int result = tagName.compare(temp.left(pos));
-
-	if (result > 0) {
-	  continue;
-	} else if (result < 0) {
-	  return false;
-	} else if (pos >= length) {
-	  return true;
-	} else {
-	  QChar chr{temp.at(pos)};
-	  
-	  return chr.isSpace() || chr == '>' ||
-	    (chr == '/' && ++pos < length && temp.at(pos) == '>');
-	}
-      }
-      
-      return false;
-    }
-  }
-
-  return false;
+bool LineHandler::matchHTMLTag() const {
+  return HTMLTag::isType6Tag(line_.mid(physicalPosition_));
 }
 
 int LineHandler::findHeadingMarker() {
@@ -293,7 +321,7 @@ int LineHandler::findHeadingMarker() {
       break;
     } else if (chr == '\t') {
       pos = pos + 1;
-      offset = TAB_SIZE - logical % TAB_SIZE - 1;
+      offset = tabWidth(pos) - 1;
       logical = logical + 1;
 
       break;
@@ -333,12 +361,12 @@ bool LineHandler::matchBlockQuote() {
     QChar chr{line_.at(physicalPosition_)};
 
     if (chr == '\t') {
-      int tabSize{TAB_SIZE - logicalPosition_ % TAB_SIZE};
+      int tabSize{tabWidth(physicalPosition_)};
       indent_ += tabSize;
 
       if (indent_ > 3) {
 	if (line_.at(lastPhysical) == '\t') {
-	  offset_ = TAB_SIZE - lastLogical % TAB_SIZE - 1;
+	  offset_ = tabWidth(lastPhysical) - 1;
 	}
 
 	logicalPosition_ = lastLogical + 1;
@@ -355,7 +383,7 @@ bool LineHandler::matchBlockQuote() {
 
       if (indent_ > 3) {
 	if (line_.at(lastPhysical) == '\t') {
-	  offset_ = TAB_SIZE - lastLogical % TAB_SIZE - 1;
+	  offset_ = tabWidth(lastPhysical) - 1;
 	}
 
 	logicalPosition_ = lastLogical + 1;
@@ -452,7 +480,7 @@ bool LineHandler::findBullet(QChar bullet) {
     if (chr == ' ') {
       ++logical1;
     } else if (chr == '\t') {
-      logical1 += TAB_SIZE - pos1 % TAB_SIZE;
+      logical1 += tabWidth(pos1);
     } else {
       break;
     }
@@ -487,7 +515,7 @@ QStringRef LineHandler::findDigit() {
     if (chr == ' ') {
       ++logical;
     } else if (chr == '\t') {
-      logical += TAB_SIZE - begin % TAB_SIZE;
+      logical += tabWidth(begin);
     } else {
       break;
     }
@@ -541,15 +569,13 @@ bool LineHandler::skipWhitespaceFollowedListMarker(int beginPos, int beginLogica
 	return true;
       }
     } else if (chr == '\t') {
-      int diff{TAB_SIZE - logical % TAB_SIZE};
+      int diff{tabWidth(pos)};
       logical += diff;
       count += diff;
       
       if (count > 4) {
-	logical = beginLogical;
-
-	if (line_.at(logical) == '\t') {
-	  offset_ = TAB_SIZE - logical % TAB_SIZE - 1;
+	if (line_.at(beginPos) == '\t') {
+	  offset_ = tabWidth(beginPos) - 1;
 	} else {
 	  offset_ = 0;
 	}
@@ -601,6 +627,8 @@ bool LineHandler::isHTMLTagType7() const {
 }
 
 bool LineHandler::isBlank() const {
+  if (isAtIndexedHead()) return index_->isBlank(number_);
+
   int length{line_.length()};
   
   for (int i{physicalPosition_}; i < length; ++i) {
@@ -612,17 +640,46 @@ bool LineHandler::isBlank() const {
   return true;
 }
 
-QString LineHandler::noWhitespace() const {
-  QString temp;
+// Whether the rest is three or more of '-', '*' or '_', and spaces or tabs
+bool LineHandler::isThematicBreak() const {
+  QChar marker{};
+  int count{0};
   int length{line_.length()};
-  
+
   for (int i{physicalPosition_}; i < length; ++i) {
     QChar chr{line_.at(i)};
-    
-    if (chr != ' ' && chr != '\t') {
-      temp += chr;
+
+    if (chr == ' ' || chr == '\t') continue;
+
+    if (marker.isNull()) {
+      if (chr != '-' && chr != '*' && chr != '_') return false;
+
+      marker = chr;
+    } else if (chr != marker) {
+      return false;
     }
+
+    ++count;
+  }
+
+  return count >= 3;
+}
+
+// Returns 1 if the trimmed rest is a sequence of '=', 2 if of '-', otherwise 0.
+// A rest of only other whitespace than spaces and tabs is taken as '-' as it
+// has been.
+int LineHandler::setextHeadingLevel() const {
+  QStringRef text{line_.mid(physicalPosition_).trimmed()};
+
+  if (text.isEmpty()) return 2;
+
+  QChar marker{text.at(0)};
+
+  if (marker != '=' && marker != '-') return 0;
+
+  for (QChar chr : text) {
+    if (chr != marker) return 0;
   }
 
-  return temp;
+  return marker == '=' ? 1 : 2;
 }
@@ -20,15 +20,41 @@
 #pragma once
 
 #include <QString>
-#include <QRegularExpressionMatch>
 
+class LineIndex;
+
+
+// A part of a line of the input: offset columns of spaces, which are the rest of
+// a partially consumed tab, followed by text
+struct LineSpan {
+  QStringRef text;
+  int offset;
+};
 
 class LineHandler {
 public:
+  // The kinds of blocks a line can start, by its first non-space character
+  enum BlockStart {
+    HTMLBlockStart = 0x01,
+    FencedCodeStart = 0x02,
+    SetextUnderline = 0x04,
+    ThematicBreakStart = 0x08,
+    HeadingStart = 0x10,
+    BlockQuoteStart = 0x20,
+    BulletListStart = 0x40,
+    OrderedListStart = 0x80,
+    AnyBlockStart = 0xff
+  };
+
+  static const int TAB_SIZE;
+
   explicit LineHandler(const QStringRef& line);
+  LineHandler(const LineIndex& index, int number);
   
+  static int blockStartsOf(QChar chr);
+
+  int blockStarts() const;
   int countIndent() const;
-  QString currentText() const;
   int depth() const;
   QChar findBullet();
   int findHeadingMarker();
@@ -39,26 +65,26 @@ public:
   bool isAutolink() const;
   bool isBlank() const;
   bool isHTMLTagType7() const;
+  bool isThematicBreak() const;
   bool matchBlockQuote();
-  bool matchHTMLCloseTag(const QRegularExpression& tag) const;
-  bool matchHTMLOpenTag(const QRegularExpression& tag) const;
-  bool matchHTMLTag(const QStringList& tagList) const;
-  QRegularExpressionMatch matchHTMLTag() const;
-  QString noWhitespace() const;
+  bool matchHTMLCloseTag(int type) const;
+  int matchHTMLOpenTag() const;
+  bool matchHTMLTag() const;
   int position() const;
-  QString putLinebreakAtBOL() const;
-  QString putLinebreakAtEOL() const;
   LineHandler removeIndent(int indent) const;
   void removeLastSequence(QChar chr);
+  int setextHeadingLevel() const;
   int skipFenceChar(QChar fenceChr);
   void skipWhitespace();
-  QString trimmed() const;
+  LineSpan span() const;
+  LineSpan trimmedSpan() const;
 
 private:
+  int column(int physical) const;
   bool findBullet(QChar bullet);
+  bool isAtIndexedHead() const;
   bool skipWhitespaceFollowedListMarker(int pos2, int logical2);
-
-  static const int TAB_SIZE;
+  int tabWidth(int physical) const;
 
   LineHandler(const QStringRef& line, int physicalPosition, int logicalPosition, int offset, int depth, int indent);
 
@@ -70,4 +96,6 @@ private:
   int offset_;
   int depth_;
   int indent_;
+  const LineIndex* index_; // the metadata of line_, if any
+  int number_;
 };
@@ -0,0 +1,184 @@
+// md-parser/lineindex.cpp - the metadata of the lines of a document
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "lineindex.hpp"
+
+#include "linehandler.hpp"
+
+
+namespace {
+  bool isSpaceOrTab(QChar chr) {
+    return chr == ' ' || chr == '\t';
+  }
+
+  // Returns whether line begins with '[' after the markers of block quotes and
+  // list items and the spaces around them
+  bool beginsWithBracket(const QStringRef& line) {
+    const int length{line.length()};
+    int pos{0};
+
+    while (pos < length) {
+      QChar chr{line.at(pos)};
+
+      if (chr == '[') return true;
+
+      if (chr == '-' || chr == '+' || chr == '*') {
+	if (pos + 1 < length && !isSpaceOrTab(line.at(pos + 1))) return false;
+      } else if (chr.isDigit()) {
+	while (pos + 1 < length && line.at(pos + 1).isDigit()) ++pos;
+
+	if (++pos >= length || (line.at(pos) != '.' && line.at(pos) != ')') ||
+	    (pos + 1 < length && !isSpaceOrTab(line.at(pos + 1)))) {
+	  return false;
+	}
+      } else if (chr != '>' && !isSpaceOrTab(chr)) {
+	return false;
+      }
+
+      ++pos;
+    }
+
+    return false;
+  }
+}
+
+
+LineIndex::LineIndex(const QString& text)
+  : text_(&text),
+    offsets_(),
+    lengths_(),
+    indents_(),
+    textOffsets_(),
+    blockStarts_(),
+    columnMaps_(),
+    columns_()
+{
+  const int length{text.length()};
+  int begin{0};
+  int nextTab{text.indexOf('\t')};
+
+  // allocated once, so that indexing more lines does not allocate more often
+  const int lineCount{text.count('\n') + 1};
+  offsets_.reserve(lineCount);
+  lengths_.reserve(lineCount);
+  indents_.reserve(lineCount);
+  textOffsets_.reserve(lineCount);
+  blockStarts_.reserve(lineCount);
+  columnMaps_.reserve(lineCount);
+
+  for (;;) {
+    int end{text.indexOf('\n', begin)};
+
+    if (end < 0) end = length;
+
+    int pos{begin};
+    int column{0};
+
+    for (; pos < end; ++pos) {
+      QChar chr{text.at(pos)};
+
+      if (chr == '\t') {
+	column += LineHandler::TAB_SIZE - column % LineHandler::TAB_SIZE;
+      } else if (chr == ' ') {
+	++column;
+      } else {
+	break;
+      }
+    }
+
+    offsets_.append(begin);
+    lengths_.append(end - begin);
+    indents_.append(column);
+    textOffsets_.append(pos - begin);
+    blockStarts_.append(pos < end ? LineHandler::blockStartsOf(text.at(pos)) : LineHandler::AnyBlockStart);
+
+    if (nextTab >= 0 && nextTab < end) {
+      columnMaps_.append(columns_.size());
+      column = 0;
+
+      for (pos = begin; pos < end; ++pos) {
+	columns_.append(column);
+	column += text.at(pos) == '\t' ? LineHandler::TAB_SIZE - column % LineHandler::TAB_SIZE : 1;
+      }
+
+      columns_.append(column);
+      nextTab = text.indexOf('\t', end);
+    } else {
+      columnMaps_.append(-1);
+    }
+
+    if (end == length) break;
+
+    begin = end + 1;
+  }
+}
+
+int LineIndex::blockStarts(int number) const {
+  return blockStarts_.at(number);
+}
+
+// Returns the column of the character at pos of a line, with tab stops of
+// LineHandler::TAB_SIZE
+int LineIndex::column(int number, int pos) const {
+  int map{columnMaps_.at(number)};
+
+  return map < 0 ? pos : columns_.at(map + pos);
+}
+
+int LineIndex::indent(int number) const {
+  return indents_.at(number);
+}
+
+bool LineIndex::isBlank(int number) const {
+  return textOffsets_.at(number) == lengths_.at(number);
+}
+
+// Returns the last line which may start a link reference definition, which
+// begins with '[' after the markers of containers, or -1
+int LineIndex::lastDefinitionLine() const {
+  const int containerStarts{LineHandler::BlockQuoteStart | LineHandler::BulletListStart |
+      LineHandler::OrderedListStart};
+
+  for (int number{size() - 1}; number >= 0; --number) {
+    if (isBlank(number)) continue;
+
+    const int pos{offsets_.at(number) + textOffsets_.at(number)};
+
+    if (text_->at(pos) == '[') return number;
+
+    if ((blockStarts_.at(number) & containerStarts) &&
+	beginsWithBracket(text_->midRef(pos, lengths_.at(number) - textOffsets_.at(number)))) {
+      return number;
+    }
+  }
+
+  return -1;
+}
+
+QStringRef LineIndex::line(int number) const {
+  return QStringRef(text_, offsets_.at(number), lengths_.at(number));
+}
+
+int LineIndex::size() const {
+  return offsets_.size();
+}
+
+int LineIndex::textOffset(int number) const {
+  return textOffsets_.at(number);
+}
@@ -0,0 +1,52 @@
+// md-parser/lineindex.hpp - the metadata of the lines of a document
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+
+// The lines of a document, split at '\n' as QString::splitRef() does, with the
+// metadata of their heads gathered in one pass before block parsing.  Each
+// item is kept in an array of its own.  The lines with tabs also get a map
+// from the positions of their characters to columns.
+class LineIndex {
+public:
+  explicit LineIndex(const QString& text);
+
+  int blockStarts(int number) const;
+  int column(int number, int pos) const;
+  int indent(int number) const;
+  bool isBlank(int number) const;
+  int lastDefinitionLine() const;
+  QStringRef line(int number) const;
+  int size() const;
+  int textOffset(int number) const;
+
+private:
+  const QString* text_;
+  QVector<int> offsets_;      // of the lines in text_
+  QVector<int> lengths_;
+  QVector<int> indents_;      // the columns of the leading spaces and tabs
+  QVector<int> textOffsets_;  // of the first other character, or the length
+  QVector<uchar> blockStarts_; // LineHandler::BlockStart flags for that character
+  QVector<int> columnMaps_;   // the first of the columns of a line in columns_, or -1 without tabs
+  QVector<int> columns_;      // the columns of each character and the end of the lines with tabs
+};
@@ -16,13 +16,26 @@
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
 #include <iostream>
+#include <string>
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QProcess>
 #include <QStringList>
-#include <QTextStream>
+#include <QThread>
+#include <QVector>
 #include <QXmlStreamReader>
+#include "allocationhook.hpp"
+#include "mdparser.h"
+#ifndef MDPARSER_NO_TESTS
 #include "mdparser_test.hpp"
-#include "parser.hpp"
+#endif
+#include "outputwriter.hpp"
 
 const char* program_name{"MD Parser"};
 const char* descreption{"A markdown parser for CommonMark Spec v"};
@@ -34,21 +47,111 @@ const char* help_info{
   "usage: mdparser [<option> ...]\n"
     " File and expression options:\n"
     "  --author: show author\n"
+    "  --bench-startup [<runs>] : Measure the time from process start to the first\n"
+    "      output of a one-line document, <runs> times (default 20)\n"
+    "  --coprocess [-0] : Parse framed documents from stdin until EOF, writing\n"
+    "      each result as <byte count>\\n<html>; input frames are length-prefixed\n"
+    "      the same way, or NUL-terminated with -0\n"
+    "  --excerpt <blocks> <bytes> <option> ... : Render only the first <blocks>\n"
+    "      top-level blocks of the following -l, -p or --coprocess option, and\n"
+    "      those beginning within <bytes> bytes of HTML (0 for no limit)\n"
     "  -h, --help : Show this information and exits, ignoring other options\n"
+    "  --mem-stats <option> ... : Report the memory use of each document of the\n"
+    "      following -l, -p or --coprocess option to stderr\n"
     "  -l <file>, --load <file> : Load and parse <filename>, prints results\n"
+    "  --outline <option> ... : Print the headings of the documents of the following\n"
+    "      -l, -p or --coprocess option instead of HTML, one per line as\n"
+    "      <level> <line> <inline HTML>\n"
     "  -p <exprs>, --parse <exprs> : Parse <exprs>, prints results\n"
+    "  --plain <option> ... : Print the text of the documents of the following -l,\n"
+    "      -p or --coprocess option without markup, instead of HTML\n"
     "  -s, --spec : Show specification info\n"
-    "  -t, --test : Run tests, ignoring other options\n"
+    "  -t [<file> ...] [<repeats>], --test [<file> ...] [<repeats>] : Run the tests\n"
+    "      of each <file> (test.xml, or the spec.json or spec.txt of the CommonMark\n"
+    "      spec; default test.xml), ignoring other options; each example is timed\n"
+    "      over <repeats> runs (default 1) and the slowest are reported\n"
+    "  --threads <n> <option> ... : Parse large documents of the following -l, -p\n"
+    "      or --coprocess option with <n> threads, or run the tests of -t on <n>\n"
+    "      threads (default: the number of cores)\n"
     "  -v, --version : Show version\n"
     };
 
-void parseList(const QStringList& list) {
-  Parser parser{};
+// Options for -l, -p and --coprocess given before them
+struct RenderOptions {
+  int threads;  // 0 for the default of each option
+  bool memStats;
+  bool plainText;
+  bool outline;
+  int excerptBlocks;  // 0 for no limit
+  int excerptBytes;
+};
+
+mdparser* newParser(const RenderOptions& options) {
+  mdparser* parser{mdparser_new()};
+
+  if (options.threads > 0) mdparser_set_threads(parser, options.threads);
+
+  if (options.plainText) mdparser_set_plain_text(parser, 1);
+
+  if (options.outline) mdparser_set_outline(parser, 1);
+
+  if (options.excerptBlocks > 0 || options.excerptBytes > 0) {
+    mdparser_set_excerpt(parser, options.excerptBlocks, static_cast<size_t>(options.excerptBytes));
+  }
+
+  return parser;
+}
+
+void reportMemStats(const mdparser* parser) {
+  mdparser_mem_stats stats{};
+  stats.size = sizeof(mdparser_mem_stats);
+  mdparser_get_mem_stats(parser, &stats);
+
+  std::cerr << "Memory (" << stats.input_bytes << " bytes of input):" << std::endl;
+  std::cerr << "  blocks: " << stats.blocks << std::endl;
+  std::cerr << "  block parsing: " << stats.block_parsing_allocations << " allocations, "
+	    << stats.block_parsing_bytes << " bytes" << std::endl;
+  std::cerr << "  inline parsing: " << stats.inline_parsing_allocations << " allocations, "
+	    << stats.inline_parsing_bytes << " bytes" << std::endl;
+  std::cerr << "  rendering: " << stats.rendering_allocations << " allocations, "
+	    << stats.rendering_bytes << " bytes" << std::endl;
+  std::cerr << "  blocks growing output: " << stats.output_growing_blocks << std::endl;
+  std::cerr << "  peak: " << stats.peak_bytes << " bytes";
+
+  if (stats.input_bytes > 0) {
+    std::cerr << " (" << static_cast<double>(stats.peak_bytes) / stats.input_bytes << " x input)";
+  }
+
+  std::cerr << std::endl;
+}
+
+QByteArray render(mdparser* parser, const QByteArray& mdText) {
+  QByteArray html{};
+  size_t length{0};
+
+  if (mdparser_render(parser, mdText.constData(), mdText.size(), nullptr, 0, &length) ==
+      MDPARSER_BUFFER_TOO_SMALL) {
+    html.resize(static_cast<int>(length));
+    mdparser_render(parser, mdText.constData(), mdText.size(), html.data(), length, &length);
+  }
+
+  return html;
+}
+
+void parseList(const QStringList& list, const RenderOptions& options) {
+  mdparser* parser{newParser(options)};
+  OutputWriter out{stdout};
   
   for (QString expr : list) {
     expr.replace("\\n", "\n").replace("\\t", "\t");
-    std::cout << qPrintable(parser.getHTMLText(expr)) << std::endl;
+    out.write(render(parser, expr.toUtf8()));
+    out.write('\n');
+
+    if (options.memStats) reportMemStats(parser);
   }
+
+  out.flush();
+  mdparser_free(parser);
 }
 
 void showAuthor() {
@@ -71,7 +174,7 @@ void showHelp() {
   std::cout << help_info << std::flush;
 }
 
-void load(const QString& filename) {
+void load(const QString& filename, const RenderOptions& options) {
   QFile mdFile{filename};
 
   if (!mdFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
@@ -80,23 +183,165 @@ void load(const QString& filename) {
     return;
   }
 
-  QTextStream in{&mdFile};
-  QString mdText{in.readAll()};
-  Parser parser{};
-  std::cout << qPrintable(parser.getHTMLText(mdText)) << std::endl;
+  mdparser* parser{newParser(options)};
+  OutputWriter out{stdout};
+  out.write(render(parser, mdFile.readAll()));
+  out.write('\n');
+  out.flush();
+
+  if (options.memStats) reportMemStats(parser);
+
+  mdparser_free(parser);
 }
 
-void test() {
-  QFile xmlFile{"test.xml"};
+bool readFrame(std::istream& in, bool nulDelimited, std::string* payload) {
+  if (nulDelimited) return static_cast<bool>(std::getline(in, *payload, '\0'));
 
-  if (!xmlFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-    qWarning("Load XML File Problem\nCouldn't open test.xml.");
-    return;
+  std::string header{};
+
+  if (!std::getline(in, header)) return false;
+
+  if (header.empty() || header[0] < '0' || header[0] > '9') {
+    qWarning("Bad frame header: %s", header.c_str());
+
+    return false;
+  }
+
+  char* end{nullptr};
+  unsigned long long length{std::strtoull(header.c_str(), &end, 10)};
+
+  if (*end != '\0') {
+    qWarning("Bad frame header: %s", header.c_str());
+
+    return false;
+  }
+
+  // larger documents are refused by mdparser_render()
+  if (length > INT_MAX) {
+    qWarning("Frame too large: %s bytes", header.c_str());
+
+    return false;
+  }
+
+  payload->resize(length);
+
+  if (length > 0 && !in.read(&(*payload)[0], length)) {
+    qWarning("Truncated frame: expected %llu bytes, got %lld", length, static_cast<long long>(in.gcount()));
+
+    return false;
+  }
+
+  return true;
+}
+
+void coprocess(bool nulDelimited, const RenderOptions& options) {
+  std::ios::sync_with_stdio(false);
+
+  mdparser* parser{newParser(options)};
+  OutputWriter out{stdout};
+  std::string payload{};
+  std::string html{};
+
+  while (readFrame(std::cin, nulDelimited, &payload)) {
+    size_t length{0};
+    int status{mdparser_render(parser, payload.data(), payload.size(), &html[0], html.size(),
+			       &length)};
+
+    if (status == MDPARSER_BUFFER_TOO_SMALL) {
+      html.resize(length);
+      status = mdparser_render(parser, payload.data(), payload.size(), &html[0], html.size(),
+			       &length);
+    }
+
+    if (status != MDPARSER_OK) {
+      qWarning("Couldn't render a document: status %d", status);
+      out.write('-');
+      out.write(QByteArray::number(status));
+      out.write('\n');
+      out.flush();
+      continue;
+    }
+
+    out.write(QByteArray::number(static_cast<qulonglong>(length)));
+    out.write('\n');
+    out.write(html.data(), static_cast<int>(length));
+    out.flush();
+
+    if (options.memStats) reportMemStats(parser);
+  }
+
+  mdparser_free(parser);
+}
+
+void benchStartup(const QString& program, int runs) {
+  QVector<qint64> times{};
+
+  for (int i{0}; i < runs; ++i) {
+    QProcess process{};
+    QElapsedTimer timer{};
+    timer.start();
+    process.start(program, QStringList{"-p", "a"});
+
+    if (!process.waitForReadyRead()) {
+      qWarning("Couldn't run %s.", qPrintable(program));
+
+      return;
+    }
+
+    times.append(timer.nsecsElapsed() / 1000);
+    process.waitForFinished();
   }
 
-  MDParser_test mdTest{&xmlFile};
-  mdTest.run();
+  std::sort(times.begin(), times.end());
+
+  std::cout << "Startup (process start to first output), " << runs << " runs:" << std::endl;
+  std::cout << "  min: " << times.first() << " us" << std::endl;
+  std::cout << "  median: " << times.at(runs / 2) << " us" << std::endl;
+  std::cout << "  max: " << times.last() << " us" << std::endl;
+}
+
+#ifdef MDPARSER_NO_TESTS
+void test(const QStringList&, int) {
+  qWarning("The tests use the internals of the library, and run in a static build only.");
 }
+#else
+void test(const QStringList& args, int threads) {
+  QStringList fileNames{};
+  int repeats{1};
+
+  for (const QString& arg : args) {
+    bool isNumber{false};
+    int number{arg.toInt(&isNumber)};
+
+    if (isNumber) {
+      repeats = number;
+    } else {
+      fileNames.append(arg);
+    }
+  }
+
+  if (fileNames.isEmpty()) fileNames.append("test.xml");
+
+  // for the allocation check after the examples
+  enableAllocationHook();
+
+  for (const QString& fileName : fileNames) {
+    QFile file{fileName};
+
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+      qWarning("Load Test File Problem\nCouldn't open %s.", qPrintable(fileName));
+      continue;
+    }
+
+    if (fileNames.size() > 1) std::cout << qPrintable(fileName) << ":" << std::endl;
+
+    MDParser_test mdTest{&file, repeats, threads > 0 ? threads : QThread::idealThreadCount()};
+    mdTest.run();
+  }
+
+  MDParser_test::runChecks();
+}
+#endif
 
 int main(int argc, char *argv[]) {
   QStringList argList{};
@@ -104,7 +349,43 @@ int main(int argc, char *argv[]) {
   for (int i{1}; i < argc; ++i) {
     argList.append(argv[i]);
   }
+
+  RenderOptions options{0, false, false, false, 0, 0};
+
+  while (!argList.isEmpty()) {
+    if (argList.size() > 1 && argList[0] == "--threads") {
+      options.threads = qMax(argList[1].toInt(), 1);
+      argList.removeFirst();
+    } else if (argList.size() > 2 && argList[0] == "--excerpt") {
+      options.excerptBlocks = qMax(argList[1].toInt(), 0);
+      options.excerptBytes = qMax(argList[2].toInt(), 0);
+      argList.removeFirst();
+      argList.removeFirst();
+    } else if (argList[0] == "--mem-stats") {
+      options.memStats = true;
+
+      if (!enableAllocationHook()) qWarning("Heap allocations are not counted on this platform.");
+
+      mdparser_set_mem_stats(1);
+    } else if (argList[0] == "--plain") {
+      options.plainText = true;
+    } else if (argList[0] == "--outline") {
+      options.outline = true;
+    } else {
+      break;
+    }
+
+    argList.removeFirst();
+  }
   
+  const bool isExcerpt{options.excerptBlocks > 0 || options.excerptBytes > 0};
+
+  if ((options.plainText && (options.outline || isExcerpt)) || (options.outline && isExcerpt)) {
+    qWarning("--plain, --outline and --excerpt can't be combined.");
+
+    return 0;
+  }
+
   if (argList.isEmpty()) {
     showHelp();
   } else if (argList[0].at(0) == '-') {
@@ -112,13 +393,19 @@ int main(int argc, char *argv[]) {
       showHelp();
     } else if (argList[0] == "--author") {
       showAuthor();
+    } else if (argList[0] == "--bench-startup") {
+      QCoreApplication app{argc, argv};
+      int runs{argList.size() > 1 ? argList[1].toInt() : 0};
+      benchStartup(QCoreApplication::applicationFilePath(), runs > 0 ? runs : 20);
+    } else if (argList[0] == "--coprocess") {
+      coprocess(argList.size() > 1 && argList[1] == "-0", options);
     } else if (argList[0] == "-v" || argList[0] == "--version") {
       showVersion();
     } else if (argList[0] == "-s" || argList[0] == "--spec") {
       showSpec();
     } else if (argList[0] == "-p" || argList[0] == "--parse") {
       argList.removeFirst();
-      parseList(argList);
+      parseList(argList, options);
     } else if (argList[0] == "-l" || argList[0] == "--load") {
       if (argList.size() < 2) {
 	qWarning("No file name");
@@ -126,14 +413,16 @@ int main(int argc, char *argv[]) {
 	return 0;
       }
 
-      load(argList[1]);
+      load(argList[1], options);
     } else if (argList[0] == "-t" || argList[0] == "--test") {
-      test();
+      argList.removeFirst();
+      test(argList, options.threads);
     } else {
-      qWarning("%s: bad switch: %s\nUse the --help or -h flag for help.", argv[0], argv[1]);
+      qWarning("%s: bad switch: %s\nUse the --help or -h flag for help.", argv[0],
+	       qPrintable(argList[0]));
     }
   } else {
-    parseList(argList);
+    parseList(argList, options);
   }
 
   return 0;
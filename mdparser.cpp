@@ -0,0 +1,259 @@
+// md-parser/mdparser.cpp - C API of the markdown parser library
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "mdparser.h"
+
+#include <climits>
+#include <cstring>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include "memstats.hpp"
+#include "parser.hpp"
+
+
+struct mdparser {
+  mdparser()
+    : parser(), input(), output(), cached(false), plainText(false), outline(false), maxBlocks(0),
+      maxBytes(0), stats(), memStats() {}
+
+  Parser parser;
+  QByteArray input;  // the last input, whose HTML is kept in output
+  QByteArray output;
+  bool cached;
+  bool plainText;
+  bool outline;
+  int maxBlocks;  // of an excerpt, or 0
+  int maxBytes;
+  mdparser_stats stats;
+  mdparser_mem_stats memStats;
+};
+
+namespace {
+  // Writes each heading on a line as "<level> <line> <inline HTML>"
+  QString formatOutline(const QVector<OutlineItem>& outline) {
+    QString text{};
+
+    for (const OutlineItem& item : outline) {
+      text.append(QString::number(item.level)).append(' ').append(QString::number(item.line + 1)).append(' ');
+      text.append(QString(item.html).replace('\n', ' ')).append('\n');
+    }
+
+    return text;
+  }
+
+  int render(mdparser* parser,
+	     const char* input, size_t input_length,
+	     char* output, size_t output_capacity,
+	     size_t* output_length) {
+    if (!parser || !output_length ||
+	(!input && input_length > 0) ||
+	(!output && output_capacity > 0) ||
+	input_length > static_cast<size_t>(INT_MAX)) {
+      return MDPARSER_INVALID_ARGUMENT;
+    }
+
+    int length{static_cast<int>(input_length)};
+
+    if (!parser->cached || parser->input.size() != length ||
+	(length > 0 && std::memcmp(parser->input.constData(), input, input_length) != 0)) {
+      parser->cached = false;  // until output is the HTML of input again
+      QElapsedTimer timer{};
+      timer.start();
+      bool countsMemory{MemoryStats::isEnabled()};
+
+      if (countsMemory) MemoryStats::reset();
+
+      {
+	MemoryPhase memoryPhase{MemoryStats::BlockParsing};
+	parser->input = QByteArray(input, length);
+	QString mdText{QString::fromUtf8(parser->input)};
+	QString html{parser->plainText ? parser->parser.getPlainText(mdText) :
+	    parser->outline ? formatOutline(parser->parser.getOutline(mdText)) :
+	    parser->maxBlocks > 0 || parser->maxBytes > 0 ?
+	    parser->parser.getExcerpt(mdText, parser->maxBlocks, parser->maxBytes) :
+	    parser->parser.getHTMLText(mdText)};
+	MemoryStats::setPhase(MemoryStats::Rendering);
+	parser->output = html.toUtf8();
+      }
+
+      parser->cached = true;
+
+      if (countsMemory) {
+	MemoryStats::Counters counters{MemoryStats::counters()};
+	mdparser_mem_stats& memStats = parser->memStats;
+	memStats.blocks = counters.blocks;
+	memStats.block_parsing_allocations = counters.allocations[MemoryStats::BlockParsing];
+	memStats.block_parsing_bytes = counters.bytes[MemoryStats::BlockParsing];
+	memStats.inline_parsing_allocations = counters.allocations[MemoryStats::InlineParsing];
+	memStats.inline_parsing_bytes = counters.bytes[MemoryStats::InlineParsing];
+	memStats.rendering_allocations = counters.allocations[MemoryStats::Rendering];
+	memStats.rendering_bytes = counters.bytes[MemoryStats::Rendering];
+	memStats.peak_bytes = counters.peakBytes;
+	memStats.input_bytes = input_length;
+	memStats.output_growing_blocks = counters.outputGrowingBlocks;
+      }
+
+      ++parser->stats.documents;
+      parser->stats.input_bytes += input_length;
+      parser->stats.output_bytes += static_cast<unsigned long long>(parser->output.size());
+      parser->stats.parse_nsecs += static_cast<unsigned long long>(timer.nsecsElapsed());
+    }
+
+    *output_length = static_cast<size_t>(parser->output.size());
+
+    if (*output_length > output_capacity) return MDPARSER_BUFFER_TOO_SMALL;
+
+    if (*output_length > 0) std::memcpy(output, parser->output.constData(), *output_length);
+
+    return MDPARSER_OK;
+  }
+}
+
+
+// No exception may leave the functions of the C API.
+mdparser* mdparser_new() {
+  try {
+    return new mdparser();
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+int mdparser_render(mdparser* parser,
+		    const char* input, size_t input_length,
+		    char* output, size_t output_capacity,
+		    size_t* output_length) {
+  try {
+    return render(parser, input, input_length, output, output_capacity, output_length);
+  } catch (...) {
+    return MDPARSER_INTERNAL_ERROR;
+  }
+}
+
+int mdparser_set_threads(mdparser* parser, int threads) {
+  try {
+    if (!parser || threads < 1) return MDPARSER_INVALID_ARGUMENT;
+
+    parser->parser.setThreadCount(threads);
+
+    return MDPARSER_OK;
+  } catch (...) {
+    return MDPARSER_INTERNAL_ERROR;
+  }
+}
+
+int mdparser_set_plain_text(mdparser* parser, int enabled) {
+  try {
+    if (!parser || (enabled && (parser->outline || parser->maxBlocks > 0 || parser->maxBytes > 0))) {
+      return MDPARSER_INVALID_ARGUMENT;
+    }
+
+    if (parser->plainText != (enabled != 0)) parser->cached = false;
+
+    parser->plainText = enabled != 0;
+
+    return MDPARSER_OK;
+  } catch (...) {
+    return MDPARSER_INTERNAL_ERROR;
+  }
+}
+
+int mdparser_set_outline(mdparser* parser, int enabled) {
+  try {
+    if (!parser || (enabled && (parser->plainText || parser->maxBlocks > 0 || parser->maxBytes > 0))) {
+      return MDPARSER_INVALID_ARGUMENT;
+    }
+
+    if (parser->outline != (enabled != 0)) parser->cached = false;
+
+    parser->outline = enabled != 0;
+
+    return MDPARSER_OK;
+  } catch (...) {
+    return MDPARSER_INTERNAL_ERROR;
+  }
+}
+
+int mdparser_set_excerpt(mdparser* parser, int max_blocks, size_t max_bytes) {
+  try {
+    if (!parser || max_blocks < 0) return MDPARSER_INVALID_ARGUMENT;
+
+    int maxBytes{max_bytes > static_cast<size_t>(INT_MAX) ? 0 : static_cast<int>(max_bytes)};
+
+    if ((parser->plainText || parser->outline) && (max_blocks > 0 || maxBytes > 0)) {
+      return MDPARSER_INVALID_ARGUMENT;
+    }
+
+    if (parser->maxBlocks != max_blocks || parser->maxBytes != maxBytes) parser->cached = false;
+
+    parser->maxBlocks = max_blocks;
+    parser->maxBytes = maxBytes;
+
+    return MDPARSER_OK;
+  } catch (...) {
+    return MDPARSER_INTERNAL_ERROR;
+  }
+}
+
+int mdparser_get_stats(const mdparser* parser, mdparser_stats* stats) {
+  try {
+    if (!parser || !stats || stats->size < sizeof(size_t)) return MDPARSER_INVALID_ARGUMENT;
+
+    size_t size{stats->size < sizeof(mdparser_stats) ? stats->size : sizeof(mdparser_stats)};
+    mdparser_stats copy(parser->stats);
+    copy.size = size;
+    std::memcpy(stats, &copy, size);
+
+    return MDPARSER_OK;
+  } catch (...) {
+    return MDPARSER_INTERNAL_ERROR;
+  }
+}
+
+void mdparser_set_mem_stats(int enabled) {
+  MemoryStats::setEnabled(enabled != 0);
+}
+
+void mdparser_count_allocation(size_t size) {
+  MemoryStats::countAllocation(size);
+}
+
+void mdparser_count_deallocation(size_t size) {
+  MemoryStats::countDeallocation(size);
+}
+
+int mdparser_get_mem_stats(const mdparser* parser, mdparser_mem_stats* stats) {
+  try {
+    if (!parser || !stats || stats->size < sizeof(size_t)) return MDPARSER_INVALID_ARGUMENT;
+
+    size_t size{stats->size < sizeof(mdparser_mem_stats) ? stats->size : sizeof(mdparser_mem_stats)};
+    mdparser_mem_stats copy(parser->memStats);
+    copy.size = size;
+    std::memcpy(stats, &copy, size);
+
+    return MDPARSER_OK;
+  } catch (...) {
+    return MDPARSER_INTERNAL_ERROR;
+  }
+}
+
+void mdparser_free(mdparser* parser) {
+  delete parser;
+}
@@ -0,0 +1,135 @@
+// md-parser/mdparser.h - C API of the markdown parser library
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef MDPARSER_H
+#define MDPARSER_H
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(MDPARSER_SHARED)
+#  if defined(MDPARSER_BUILD)
+#    define MDPARSER_API __declspec(dllexport)
+#  else
+#    define MDPARSER_API __declspec(dllimport)
+#  endif
+#else
+#  define MDPARSER_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Status codes
+#define MDPARSER_OK 0
+#define MDPARSER_BUFFER_TOO_SMALL 1
+#define MDPARSER_INVALID_ARGUMENT 2
+#define MDPARSER_INTERNAL_ERROR 3  // the library failed, e.g. out of memory
+
+typedef struct mdparser mdparser;
+
+// Set size to sizeof(mdparser_stats) before calling mdparser_get_stats(), so
+// that fields appended in later versions are never written past the struct.
+typedef struct mdparser_stats {
+  size_t size;
+  unsigned long long documents;     // number of documents rendered
+  unsigned long long input_bytes;   // total size of the rendered input
+  unsigned long long output_bytes;  // total size of the produced HTML
+  unsigned long long parse_nsecs;   // total time spent in the parser
+} mdparser_stats;
+
+// Memory use of the last document parsed, counted while enabled by
+// mdparser_set_mem_stats().  Set size as for mdparser_stats.
+typedef struct mdparser_mem_stats {
+  size_t size;
+  unsigned long long blocks;                      // Block nodes created
+  unsigned long long block_parsing_allocations;  // heap allocations and their
+  unsigned long long block_parsing_bytes;        // bytes in each phase
+  unsigned long long inline_parsing_allocations;
+  unsigned long long inline_parsing_bytes;
+  unsigned long long rendering_allocations;
+  unsigned long long rendering_bytes;
+  unsigned long long peak_bytes;   // peak of live heap bytes during the parse
+  unsigned long long input_bytes;  // size of the document
+  unsigned long long output_growing_blocks;  // leaf blocks growing the HTML past its estimate
+} mdparser_mem_stats;
+
+// Creates a parser, or returns NULL on failure.
+MDPARSER_API mdparser* mdparser_new(void);
+
+// Renders input_length bytes of UTF-8 markdown into output as UTF-8 HTML, which
+// is not NUL-terminated.  *output_length is set to the size of the HTML.  If it
+// exceeds output_capacity, nothing is written and MDPARSER_BUFFER_TOO_SMALL is
+// returned; the HTML is kept, so calling again with the same input and a large
+// enough buffer only copies it.  Pass NULL and 0 to query the size.
+MDPARSER_API int mdparser_render(mdparser* parser,
+				 const char* input, size_t input_length,
+				 char* output, size_t output_capacity,
+				 size_t* output_length);
+
+// Sets the number of threads used to parse a large document, split at blank
+// lines between top-level blocks; the HTML does not depend on it.  Default 1.
+MDPARSER_API int mdparser_set_threads(mdparser* parser, int threads);
+
+// Sets whether mdparser_render() writes the text of documents without markup,
+// for indexing, instead of HTML: entities and escapes are decoded, code is kept
+// as it is and HTML is left out.  Plain text has no excerpt, so enabling it
+// while an excerpt or the outline is set returns MDPARSER_INVALID_ARGUMENT.
+// Default 0.
+MDPARSER_API int mdparser_set_plain_text(mdparser* parser, int enabled);
+
+// Sets whether mdparser_render() writes the headings of documents, for a table
+// of contents, instead of HTML: one line per heading, as "<level> <line>
+// <inline HTML>", where the line is numbered from 1 and line breaks in the
+// heading are written as spaces.  Links defined anywhere in the document are
+// resolved, and no other inline text is parsed.  Enabling it while plain text
+// or an excerpt is set returns MDPARSER_INVALID_ARGUMENT.  Default 0.
+MDPARSER_API int mdparser_set_outline(mdparser* parser, int enabled);
+
+// Limits the HTML of mdparser_render() to the first max_blocks top-level
+// blocks, and to the blocks which begin before it reaches max_bytes; 0 is no
+// limit.  The excerpt is the beginning of the full HTML; the rest of the
+// document is parsed only as far as a link reference definition may be, and
+// none of its inline text.  Setting a limit while plain text or the outline is
+// enabled returns MDPARSER_INVALID_ARGUMENT.  Default 0 and 0.
+MDPARSER_API int mdparser_set_excerpt(mdparser* parser, int max_blocks, size_t max_bytes);
+
+// Copies the counters of parser into stats (see mdparser_stats).
+MDPARSER_API int mdparser_get_stats(const mdparser* parser, mdparser_stats* stats);
+
+// Enables or disables memory accounting of all parsers.  The counters are
+// process-wide, so documents should be rendered one at a time while enabled.
+// Heap allocations are counted only if the client reports them with
+// mdparser_count_allocation() and mdparser_count_deallocation() from an
+// allocator hook; these must be called for every allocation while enabled.
+MDPARSER_API void mdparser_set_mem_stats(int enabled);
+MDPARSER_API void mdparser_count_allocation(size_t size);
+MDPARSER_API void mdparser_count_deallocation(size_t size);
+
+// Copies the memory use of the last document rendered by parser into stats.
+MDPARSER_API int mdparser_get_mem_stats(const mdparser* parser, mdparser_mem_stats* stats);
+
+// Destroys parser.  NULL is ignored.
+MDPARSER_API void mdparser_free(mdparser* parser);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MDPARSER_H
@@ -1,32 +1,9 @@
-TEMPLATE = app
-TARGET = mdparser
-INCLUDEPATH += .
+TEMPLATE = subdirs
 
-# Input
-HEADERS += block.hpp \
-           character.hpp \
-           containerblock.hpp \
-           htmltag.hpp \
-           inlineparser.hpp \
-           leafblock.hpp \
-           linehandler.hpp \
-           mdparser_test.hpp \
-           parser.hpp \
-           precedence.hpp \
-           texthandler.hpp
+# Build the library as a shared one with "qmake CONFIG+=mdparser_shared"
+SUBDIRS = lib \
+          app
 
-SOURCES += block.cpp \
-           character.cpp \
-           containerblock.cpp \
-           htmltag.cpp \
-           inlineparser.cpp \
-           leafblock.cpp \
-           linehandler.cpp \
-           main.cpp \
-           mdparser_test.cpp \
-           parser.cpp \
-           precedence.cpp \
-           texthandler.cpp
-
-CONFIG += c++11 \
-    debug
+lib.file = libmdparser.pro
+app.file = mdparser_app.pro
+app.depends = lib
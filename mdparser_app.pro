@@ -0,0 +1,27 @@
+TEMPLATE = app
+TARGET = mdparser
+INCLUDEPATH += .
+
+LIBS += -L$$OUT_PWD -lmdparser
+
+# Input
+HEADERS += allocationhook.hpp \
+           mdparser.h \
+           outputwriter.hpp
+
+SOURCES += allocationhook.cpp \
+           main.cpp \
+           outputwriter.cpp
+
+# The test runner uses Parser and MemoryStats, which a shared library does
+# not export; -t is available in a static build only.
+mdparser_shared {
+    DEFINES += MDPARSER_SHARED MDPARSER_NO_TESTS
+} else {
+    unix: PRE_TARGETDEPS += $$OUT_PWD/libmdparser.a
+    HEADERS += mdparser_test.hpp
+    SOURCES += mdparser_test.cpp
+}
+
+CONFIG += c++11 \
+    debug
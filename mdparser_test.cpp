@@ -19,23 +19,277 @@
 
 #include "mdparser_test.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <QByteArray>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+#include <QStringList>
 #include <QXmlStreamReader>
+#include "documenthandler.hpp"
+#include "mdparser.h"
+#include "memstats.hpp"
 #include "parser.hpp"
 
 
-MDParser_test::MDParser_test(QFile* xmlFile)
-  : xmlFile_(xmlFile)
+namespace {
+  // The number of the slowest examples reported.
+  const int SLOWEST_COUNT{10};
+
+  // The fences of the examples in spec.txt
+  const QString EXAMPLE_BEGIN{"```````````````````````````````` example"};
+  const QString EXAMPLE_END{"````````````````````````````````"};
+
+  // The spec ends the HTML of an example with a newline, which Parser does not.
+  QString chopNewline(QString html) {
+    if (html.endsWith('\n')) html.chop(1);
+
+    return html;
+  }
+
+  // Paragraph continuation lines which block start recognizers look at before
+  // taking them as text.  Block parsing must not allocate for any of them.
+  const char* const PLAIN_LINES[]{
+    "plain text",
+    "-not a list item",
+    "*emphasis* and text",
+    "== not an underline",
+    "___ not a thematic break",
+    "1.5 is not a list item",
+    "#not a heading",
+    "``code`` is not a fence",
+  };
+
+  // The number of plain lines in the smaller paragraph of the allocation check
+  const int PLAIN_LINE_COUNT{1024};
+
+  // The allocations of doubling the lines of a paragraph, by the growth of its
+  // list of lines
+  const unsigned long long MAX_EXTRA_ALLOCATIONS{2};
+
+  // Headings in containers, a setext heading and a heading whose link is
+  // defined after it, and their outline
+  const char OUTLINE_MARKDOWN[]{
+    "# Title\n"
+    "\n"
+    "- ## In a *list*\n"
+    "\n"
+    "> ### In a quote\n"
+    "> > #### Deeper\n"
+    "\n"
+    "Setext [link]\n"
+    "and more\n"
+    "-------\n"
+    "\n"
+    "[link]: /later\n"
+  };
+  const char OUTLINE[]{
+    "1 1 Title\n"
+    "2 3 In a <em>list</em>\n"
+    "3 5 In a quote\n"
+    "4 6 Deeper\n"
+    "2 8 Setext <a href=\"/later\">link</a> and more\n"
+  };
+
+  // A paragraph in a list item in a block quote with a link defined at the end,
+  // and a heading with a code span, where EventRecorder stops
+  const char EVENTS_MARKDOWN[]{
+    "> - quoted *em*\n"
+    ">   and [link]\n"
+    "\n"
+    "# Stop `here`\n"
+    "\n"
+    "Not reported\n"
+    "\n"
+    "[link]: /later \"Title\"\n"
+  };
+  const char EVENTS[]{
+    "start 1 0-30\n"
+    "start 2 0-30\n"
+    "start 4 0-30\n"
+    "start 5 0-30\n"
+    "text 4-11 quoted \n"
+    "enter 1 11-15\n"
+    "text 12-14 em\n"
+    "leave 1 11-15\n"
+    "text 15-24 \\nand \n"
+    "enter 3 24-30\n"
+    "link /later Title\n"
+    "text 25-29 link\n"
+    "leave 3 24-30\n"
+    "end 5 0-30\n"
+    "end 4 0-30\n"
+    "end 2 0-30\n"
+    "end 1 0-30\n"
+    "start 6 32-45\n"
+    "text 34-39 Stop \n"
+    "code 39-45 here\n"
+  };
+
+  // Writes the callbacks of DocumentHandler on a line each, with the type of a
+  // block or a span, the positions in the document and the text, and stops at
+  // the first code span.
+  class EventRecorder : public DocumentHandler {
+  public:
+    bool codeSpan(const QString& code, int begin, int end) override {
+      append("code", begin, end, code);
+      return false;
+    }
+
+    bool endBlock(Block::Type type, const SourceSpan& span) override {
+      append("end " + QString::number(type), span.begin, span.end, QString());
+      return true;
+    }
+
+    bool enterSpan(InlineEvent::SpanType type, int begin, int end) override {
+      append("enter " + QString::number(type), begin, end, QString());
+      return true;
+    }
+
+    bool leaveSpan(InlineEvent::SpanType type, int begin, int end) override {
+      append("leave " + QString::number(type), begin, end, QString());
+      return true;
+    }
+
+    bool link(const QString& destination, const QString& title) override {
+      events.append("link ").append(destination).append(' ').append(title).append('\n');
+      return true;
+    }
+
+    bool startBlock(Block::Type type, const SourceSpan& span) override {
+      append("start " + QString::number(type), span.begin, span.end, QString());
+      return true;
+    }
+
+    bool text(const QString& text, int begin, int end) override {
+      append("text", begin, end, text);
+      return true;
+    }
+
+    QString events;
+
+  private:
+    void append(const QString& name, int begin, int end, const QString& text) {
+      events.append(name).append(' ').append(QString::number(begin)).append('-').append(QString::number(end));
+
+      if (!text.isEmpty()) events.append(' ').append(QString(text).replace('\n', "\\n"));
+
+      events.append('\n');
+    }
+  };
+
+  // Returns the heap allocations of block parsing a paragraph of count lines.
+  unsigned long long countBlockParsingAllocations(Parser* parser, const QString& line, int count) {
+    QString markdown{"paragraph"};
+
+    for (int i{0}; i < count; ++i) {
+      markdown.append('\n').append(line);
+    }
+
+    MemoryStats::reset();
+    parser->getHTMLText(markdown);
+
+    return MemoryStats::counters().allocations[MemoryStats::BlockParsing];
+  }
+}
+
+
+MDParser_test::MDParser_test(QFile* file, int repeats, int threads)
+  : file_(file),
+    repeats_(repeats > 0 ? repeats : 1),
+    threads_(threads > 0 ? threads : 1),
+    examples_()
 {}
 
-void MDParser_test::run() {
-  QXmlStreamReader xmlReader{xmlFile_};
-  Parser parser;
+// Loads spec.json or spec.txt of the CommonMark spec by the file name, or
+// test.xml otherwise.
+bool MDParser_test::load() {
+  QString fileName{file_->fileName()};
+
+  if (fileName.endsWith(".json")) return loadJSON();
+
+  if (fileName.endsWith(".txt")) return loadSpecText();
+
+  return loadXML();
+}
+
+bool MDParser_test::loadJSON() {
+  QJsonParseError error{};
+  QJsonDocument json{QJsonDocument::fromJson(file_->readAll(), &error)};
+
+  if (error.error != QJsonParseError::NoError || !json.isArray()) {
+    qCritical("%s Parse Error\n%s", qPrintable(file_->fileName()), qPrintable(error.errorString()));
+
+    return false;
+  }
+
+  for (const QJsonValue& value : json.array()) {
+    QJsonObject example{value.toObject()};
+    examples_.append(Example{example.value("example").toInt(examples_.size() + 1),
+	  example.value("section").toString(),
+	  example.value("markdown").toString(),
+	  chopNewline(example.value("html").toString()),
+	  QString(),
+	  0});
+  }
+
+  return true;
+}
+
+// Reads the examples between the fences of spec.txt, in which tabs are
+// written as U+2192, each under the last heading as its section.
+bool MDParser_test::loadSpecText() {
+  enum { Text, Markdown, HTML } state{Text};
+  QString section{};
+  QString mdText{};
+  QString htmlText{};
+
+  for (const QString& line : QString::fromUtf8(file_->readAll()).split('\n')) {
+    switch (state) {
+    case Text:
+      if (line.startsWith(EXAMPLE_BEGIN)) {
+	mdText.clear();
+	htmlText.clear();
+	state = Markdown;
+      } else if (line.startsWith('#')) {
+	section = line.mid(line.indexOf(' ') + 1).trimmed();
+      }
+      break;
+
+    case Markdown:
+      if (line == ".") {
+	state = HTML;
+      } else {
+	mdText.append(line).append('\n');
+      }
+      break;
+
+    case HTML:
+      if (line.startsWith(EXAMPLE_END)) {
+	mdText.replace(QChar(0x2192), '\t');
+	htmlText.replace(QChar(0x2192), '\t');
+	examples_.append(Example{examples_.size() + 1, section, mdText, chopNewline(htmlText), QString(), 0});
+	state = Text;
+      } else {
+	htmlText.append(line).append('\n');
+      }
+      break;
+    }
+  }
+
+  return true;
+}
+
+bool MDParser_test::loadXML() {
+  QXmlStreamReader xmlReader{file_};
   QString mdText;
-  QString htmlText;
-  int okCount{0};
-  int faultCount{0};
 
   while(!xmlReader.atEnd() && !xmlReader.hasError()) {
     QXmlStreamReader::TokenType token{xmlReader.readNext()};
@@ -62,27 +316,187 @@ void MDParser_test::run() {
 
     if(token == QXmlStreamReader::StartElement) {
       if(xmlReader.name() == "html") {
-	htmlText = xmlReader.readElementText();
-
-	QString result{parser.getHTMLText(mdText)};
-
-	if (result == htmlText) {
-	  ++okCount;
-	} else {
-	  --faultCount;
-	  std::cout << "test " << okCount + faultCount << ":" << std::endl;
-	  std::cout << qPrintable(result) << std::endl;
-	}
+	examples_.append(Example{examples_.size() + 1, QString(), mdText, xmlReader.readElementText(), QString(), 0});
       }
     }
   }
 
   if(xmlReader.hasError()) {
-    qCritical("xmlFile.xml Parse Error\n%s", qPrintable(xmlReader.errorString()));
+    qCritical("%s Parse Error\n%s", qPrintable(file_->fileName()), qPrintable(xmlReader.errorString()));
+
+    return false;
+  }
+
+  return true;
+}
+
+// Compares the allocations of block parsing paragraphs of PLAIN_LINE_COUNT
+// and twice as many plain lines, which may differ only by the growth of the
+// list of lines of the paragraph.  It takes the allocation hook of the program,
+// and returns the number of lines which allocate.
+int MDParser_test::checkAllocations() {
+  const bool wasEnabled{MemoryStats::isEnabled()};
+  MemoryStats::setEnabled(true);
+  Parser parser;
+  int faultCount{0};
+
+  for (const char* line : PLAIN_LINES) {
+    unsigned long long allocations{countBlockParsingAllocations(&parser, line, PLAIN_LINE_COUNT)};
+
+    if (allocations == 0) {
+      std::cout << "Allocations per plain line: not counted on this platform" << std::endl;
+      break;
+    }
+
+    unsigned long long extra{countBlockParsingAllocations(&parser, line, PLAIN_LINE_COUNT * 2) - allocations};
+
+    if (extra > MAX_EXTRA_ALLOCATIONS) {
+      ++faultCount;
+      std::cout << "Allocating plain line: " << extra << " allocations for " << PLAIN_LINE_COUNT
+		<< " more of \"" << line << "\"" << std::endl;
+    }
+  }
+
+  MemoryStats::setEnabled(wasEnabled);
+
+  return faultCount;
+}
+
+// Runs every threads_-th example from first with a parser of its own.
+void MDParser_test::runExamples(Example* examples, int first) const {
+  Parser parser;
+
+  for (int i{first}; i < examples_.size(); i += threads_) {
+    Example& example = examples[i];
+    QElapsedTimer timer{};
+    timer.start();
+    example.result = parser.getHTMLText(example.markdown);
+    example.nsecs = timer.nsecsElapsed();
+
+    for (int j{1}; j < repeats_; ++j) {
+      timer.start();
+      parser.getHTMLText(example.markdown);
+      example.nsecs = qMin(example.nsecs, timer.nsecsElapsed());
+    }
+  }
+}
+
+void MDParser_test::run() {
+  if (!load()) return;
+
+  QElapsedTimer wallTimer{};
+  wallTimer.start();
+
+  Example* examples{examples_.data()};
+  std::vector<std::thread> threads{};
+
+  for (int i{1}; i < threads_; ++i) {
+    threads.emplace_back(&MDParser_test::runExamples, this, examples, i);
+  }
+
+  runExamples(examples, 0);
 
-    return;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  qint64 wallNsecs{wallTimer.nsecsElapsed()};
+
+  struct Section {
+    QString name;
+    int okCount;
+    int count;
+  };
+
+  QVector<Section> sections{};
+  int okCount{0};
+  int faultCount{0};
+  qint64 totalNsecs{0};
+
+  for (const Example& example : examples_) {
+    bool ok{example.result == example.html};
+    totalNsecs += example.nsecs;
+
+    if (ok) {
+      ++okCount;
+    } else {
+      ++faultCount;
+      std::cout << "test " << example.number << ":" << std::endl;
+      std::cout << qPrintable(example.result) << std::endl;
+    }
+
+    if (example.section.isEmpty()) continue;
+
+    auto section{std::find_if(sections.begin(), sections.end(),
+			      [&example](const Section& s) { return s.name == example.section; })};
+
+    if (section == sections.end()) {
+      sections.append(Section{example.section, 0, 0});
+      section = sections.end() - 1;
+    }
+
+    section->okCount += ok ? 1 : 0;
+    ++section->count;
   }
 
   std::cout << "Success: " << okCount << std::endl;
   std::cout << "Fault: " << faultCount << std::endl;
+  std::cout << "Time: " << totalNsecs / 1000 << " us (best of " << repeats_ << " runs per example)" << std::endl;
+  std::cout << "Wall time: " << wallNsecs / 1000 << " us (" << threads_ << " threads)" << std::endl;
+
+  QVector<Example> slowest{examples_};
+  int count{qMin(SLOWEST_COUNT, slowest.size())};
+  std::partial_sort(slowest.begin(), slowest.begin() + count, slowest.end(),
+		    [](const Example& a, const Example& b) { return a.nsecs > b.nsecs; });
+
+  if (count > 0) std::cout << "Slowest examples:" << std::endl;
+
+  for (int i{0}; i < count; ++i) {
+    std::cout << "  test " << slowest.at(i).number << ": " << slowest.at(i).nsecs / 1000 << " us" << std::endl;
+  }
+
+  if (!sections.isEmpty()) std::cout << "Sections:" << std::endl;
+
+  for (const Section& section : sections) {
+    std::cout << "  " << qPrintable(section.name) << ": " << section.okCount << "/" << section.count
+	      << " (" << section.okCount * 100 / section.count << "%)" << std::endl;
+  }
+}
+
+// Parses EVENTS_MARKDOWN with EventRecorder, and returns 1 if it is not
+// stopped or its events are not EVENTS, or 0.
+int MDParser_test::checkEvents() {
+  EventRecorder recorder{};
+
+  if (!recorder.parse(QString::fromUtf8(EVENTS_MARKDOWN)) && recorder.events == EVENTS) return 0;
+
+  std::cout << "Events:" << std::endl << qPrintable(recorder.events);
+
+  return 1;
+}
+
+// Renders OUTLINE_MARKDOWN in outline mode of the C API, and returns 1 if it
+// is not OUTLINE, or 0.
+int MDParser_test::checkOutline() {
+  mdparser* parser{mdparser_new()};
+  mdparser_set_outline(parser, 1);
+  char output[sizeof(OUTLINE) * 2];
+  size_t length{0};
+  int status{mdparser_render(parser, OUTLINE_MARKDOWN, sizeof(OUTLINE_MARKDOWN) - 1,
+			     output, sizeof(output), &length)};
+  mdparser_free(parser);
+
+  if (status == MDPARSER_OK && QByteArray(output, static_cast<int>(length)) == OUTLINE) return 0;
+
+  std::cout << "Outline:" << std::endl << std::string(output, status == MDPARSER_OK ? length : 0);
+
+  return 1;
+}
+
+// Runs the checks which are not examples, once for all the test files, and
+// reports each on a line of its own.
+void MDParser_test::runChecks() {
+  std::cout << "Allocating plain lines: " << checkAllocations() << std::endl;
+  std::cout << "Outline faults: " << checkOutline() << std::endl;
+  std::cout << "Event faults: " << checkEvents() << std::endl;
 }
@@ -17,14 +17,40 @@
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
+#include <QString>
+#include <QVector>
+
 class QFile;
 
 class MDParser_test {
 public:
-  explicit MDParser_test(QFile* xmlFile);
+  MDParser_test(QFile* file, int repeats = 1, int threads = 1);
 
   void run();
 
+  static void runChecks();
+
 private:
-  QFile* xmlFile_;
+  struct Example {
+    int number;
+    QString section;
+    QString markdown;
+    QString html;
+    QString result;
+    qint64 nsecs;  // the best time of the repeats
+  };
+
+  static int checkAllocations();
+  static int checkEvents();
+  static int checkOutline();
+  bool load();
+  bool loadJSON();
+  bool loadSpecText();
+  bool loadXML();
+  void runExamples(Example* examples, int first) const;
+
+  QFile* file_;
+  int repeats_;
+  int threads_;
+  QVector<Example> examples_;
 };
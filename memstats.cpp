@@ -0,0 +1,130 @@
+// md-parser/memstats.cpp - memory accounting of the parser
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "memstats.hpp"
+
+#include <atomic>
+
+
+// Nothing here may allocate, as it is called from allocation hooks.
+namespace {
+  std::atomic<bool> enabled{false};
+  std::atomic<unsigned long long> blockCount{0};
+  std::atomic<unsigned long long> allocationCounts[MemoryStats::PhaseCount];
+  std::atomic<unsigned long long> allocatedBytes[MemoryStats::PhaseCount];
+  std::atomic<long long> liveBytes{0};  // allocated since reset(), less those freed
+  std::atomic<long long> peakBytes{0};
+  std::atomic<unsigned long long> outputGrowingBlockCount{0};
+  thread_local MemoryStats::Phase currentPhase{MemoryStats::NoPhase};
+}
+
+
+bool MemoryStats::isEnabled() {
+  return enabled.load(std::memory_order_relaxed);
+}
+
+void MemoryStats::setEnabled(bool value) {
+  enabled.store(value);
+}
+
+MemoryStats::Phase MemoryStats::phase() {
+  return currentPhase;
+}
+
+void MemoryStats::setPhase(Phase phase) {
+  currentPhase = phase;
+}
+
+void MemoryStats::countBlock() {
+  if (isEnabled()) blockCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryStats::countAllocation(std::size_t size) {
+  if (!isEnabled()) return;
+
+  long long live{liveBytes.fetch_add(static_cast<long long>(size), std::memory_order_relaxed) +
+      static_cast<long long>(size)};
+  long long peak{peakBytes.load(std::memory_order_relaxed)};
+
+  while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+
+  if (currentPhase != NoPhase) {
+    allocationCounts[currentPhase].fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes[currentPhase].fetch_add(size, std::memory_order_relaxed);
+  }
+}
+
+void MemoryStats::countDeallocation(std::size_t size) {
+  if (!isEnabled()) return;
+
+  // Blocks allocated before reset() are freed too; they may not take the live
+  // bytes below those at reset(), or later peaks would be under-reported.
+  long long live{liveBytes.load(std::memory_order_relaxed)};
+
+  while (!liveBytes.compare_exchange_weak(live, live > static_cast<long long>(size) ?
+					  live - static_cast<long long>(size) : 0,
+					  std::memory_order_relaxed)) {}
+}
+
+void MemoryStats::countOutputGrowingBlock() {
+  if (isEnabled()) outputGrowingBlockCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+MemoryStats::Counters MemoryStats::counters() {
+  Counters counters{};
+  counters.blocks = blockCount.load();
+
+  for (int i{0}; i < PhaseCount; ++i) {
+    counters.allocations[i] = allocationCounts[i].load();
+    counters.bytes[i] = allocatedBytes[i].load();
+  }
+
+  counters.peakBytes = static_cast<unsigned long long>(peakBytes.load());
+  counters.outputGrowingBlocks = outputGrowingBlockCount.load();
+
+  return counters;
+}
+
+void MemoryStats::reset() {
+  blockCount.store(0);
+  outputGrowingBlockCount.store(0);
+
+  for (int i{0}; i < PhaseCount; ++i) {
+    allocationCounts[i].store(0);
+    allocatedBytes[i].store(0);
+  }
+
+  liveBytes.store(0);
+  peakBytes.store(0);
+}
+
+
+//////////////////
+// Memory Phase //
+//////////////////
+
+MemoryPhase::MemoryPhase(MemoryStats::Phase phase)
+  : previous_(MemoryStats::phase())
+{
+  MemoryStats::setPhase(phase);
+}
+
+MemoryPhase::~MemoryPhase() {
+  MemoryStats::setPhase(previous_);
+}
@@ -0,0 +1,64 @@
+// md-parser/memstats.hpp - memory accounting of the parser
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+
+
+// Process-wide counters of Block nodes and heap allocations, filled while
+// enabled.  The parser marks its phases; allocations are reported by a hook
+// of the client, e.g. one replacing malloc.
+class MemoryStats {
+public:
+  enum Phase { NoPhase = -1, BlockParsing, InlineParsing, Rendering, PhaseCount };
+
+  struct Counters {
+    unsigned long long blocks;
+    unsigned long long allocations[PhaseCount];
+    unsigned long long bytes[PhaseCount];
+    unsigned long long peakBytes;  // the peak of live bytes above those at reset()
+    unsigned long long outputGrowingBlocks;  // leaf blocks growing the HTML past its reservation
+  };
+
+  MemoryStats() = delete;
+
+  static void countAllocation(std::size_t size);
+  static void countBlock();
+  static void countDeallocation(std::size_t size);
+  static void countOutputGrowingBlock();
+  static Counters counters();
+  static bool isEnabled();
+  static Phase phase();
+  static void reset();
+  static void setEnabled(bool enabled);
+  static void setPhase(Phase phase);
+};
+
+// Attributes the allocations of the current thread to a phase in its scope.
+class MemoryPhase {
+public:
+  explicit MemoryPhase(MemoryStats::Phase phase);
+  MemoryPhase(const MemoryPhase& other) = delete;
+  MemoryPhase& operator=(const MemoryPhase& other) = delete;
+  ~MemoryPhase();
+
+private:
+  MemoryStats::Phase previous_;
+};
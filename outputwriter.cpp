@@ -0,0 +1,68 @@
+// md-parser/outputwriter.cpp - buffered output for the command line
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "outputwriter.hpp"
+
+
+OutputWriter::OutputWriter(std::FILE* file, int capacity)
+  : file_(file),
+    buffer_(),
+    capacity_(capacity)
+{
+  buffer_.reserve(capacity);
+}
+
+OutputWriter::~OutputWriter() {
+  flush();
+}
+
+void OutputWriter::flush() {
+  if (!buffer_.isEmpty()) {
+    std::fwrite(buffer_.constData(), 1, buffer_.size(), file_);
+    buffer_.clear();
+    buffer_.reserve(capacity_);
+  }
+
+  std::fflush(file_);
+}
+
+void OutputWriter::write(char chr) {
+  if (buffer_.size() >= capacity_) flush();
+
+  buffer_.append(chr);
+}
+
+void OutputWriter::write(const char* data, int size) {
+  if (buffer_.size() + size > capacity_) {
+    flush();
+
+    // too large to be buffered
+    if (size >= capacity_) {
+      std::fwrite(data, 1, size, file_);
+
+      return;
+    }
+  }
+
+  buffer_.append(data, size);
+}
+
+void OutputWriter::write(const QByteArray& bytes) {
+  write(bytes.constData(), bytes.size());
+}
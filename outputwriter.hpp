@@ -0,0 +1,44 @@
+// md-parser/outputwriter.hpp - buffered output for the command line
+// MD Parser - a markdown parser for CommonMark
+//
+// Copyright (C) 2017 Yasuhiro Yamakawa <kawatab@yahoo.co.jp>
+//
+//  This program is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or any
+//  later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+//  License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstdio>
+#include <QByteArray>
+
+
+// Collects UTF-8 output in a large buffer and writes it out when the buffer is
+// full or flush() is called, instead of flushing after every document.
+class OutputWriter {
+public:
+  explicit OutputWriter(std::FILE* file, int capacity = 1 << 16);
+  OutputWriter(const OutputWriter& other) = delete;
+  OutputWriter& operator=(const OutputWriter& other) = delete;
+  ~OutputWriter();
+
+  void flush();
+  void write(char chr);
+  void write(const char* data, int size);
+  void write(const QByteArray& bytes);
+
+private:
+  std::FILE* file_;
+  QByteArray buffer_;
+  int capacity_;
+};
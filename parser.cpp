@@ -19,14 +19,97 @@
 
 #include "parser.hpp"
 
+#include <thread>
+#include <vector>
+#include <QStringList>
 #include <QVector>
 #include "linehandler.hpp"
+#include "lineindex.hpp"
 #include "inlineparser.hpp"
+#include "memstats.hpp"
+
+
+namespace {
+  // Documents shorter than two chunks of this many lines are parsed sequentially.
+  const int MIN_CHUNK_LINES{1024};
+
+  struct Chunk {
+    int begin;
+    int end;
+    Parser* parser;
+    BodyBlock* root;
+    bool resynchronized;
+    QString html;
+  };
+
+  template <typename Function>
+  void runInParallel(QVector<Chunk>* chunks, Function function) {
+    std::vector<std::thread> threads{};
+
+    for (int i{1}; i < chunks->size(); ++i) {
+      threads.emplace_back(function, &(*chunks)[i]);
+    }
+
+    function(&(*chunks)[0]);
+
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  bool isBlank(const QStringRef& line) {
+    for (QChar c : line) {
+      if (c != ' ' && c != '\t') return false;
+    }
+
+    return true;
+  }
+
+  // Returns the length of the code fence at the head of line, or 0.
+  int getFenceLength(const QStringRef& line, QChar* fence) {
+    int pos{0};
+
+    while (pos < line.size() && pos < 3 && line.at(pos) == ' ') ++pos;
+
+    if (pos == line.size() || (line.at(pos) != '`' && line.at(pos) != '~')) return 0;
+
+    *fence = line.at(pos);
+    int length{0};
+
+    while (pos + length < line.size() && line.at(pos + length) == *fence) ++length;
+
+    return length >= 3 ? length : 0;
+  }
+
+  // Returns the size of text in UTF-8
+  int utf8Size(const QString& text) {
+    int size{0};
+
+    for (QChar c : text) {
+      size += c.unicode() < 0x80 ? 1 : (c.unicode() < 0x800 || c.isSurrogate()) ? 2 : 3;
+    }
+
+    return size;
+  }
+
+  // Whether line can only start a new top-level block after a blank line, so
+  // that no list, block quote or HTML block runs over it.
+  bool isChunkStart(const QStringRef& line) {
+    if (line.isEmpty()) return false;
+
+    QChar c{line.at(0)};
+
+    return !c.isDigit() &&
+      c != ' ' && c != '\t' && c != '-' && c != '+' && c != '*' && c != '>' && c != '<';
+  }
+}
 
 
 Parser::Parser()
-  : current_(),
+  : openBlocks_(),
     linkList_(),
+    lineNumber_(0),
+    threadCount_(1),
     inlineLinkTemplate1("<a href=\"%2\">%1</a>"),
     inlineLinkTemplate2("<a href=\"%2\" title=\"%3\">%1</a>"),
     inlineImageTemplate1("<img src=\"%2\" alt=\"%1\" />"),
@@ -37,63 +120,350 @@ Parser::~Parser() {
 }
 
 ContainerBlock* Parser::current() {
-  return this->current_;
+  return openBlocks_.isEmpty() ? nullptr : openBlocks_.last().block;
 }
 
+// The containers open above the parent of container are left without closing
+// them, as they have been closed by appending container.
 void Parser::setCurrent(ContainerBlock* container) {
-  this->current_ = container;
+  ContainerBlock* parent{container->parent()};
+  int level{openBlocks_.size() - 1};
+
+  while (level >= 0 && openBlocks_.at(level).block != parent) --level;
+
+  if (level < 0) {
+    openBlocks_.clear();
+
+    if (parent) setCurrent(parent);
+  } else {
+    openBlocks_.resize(level + 1);
+  }
+
+  openBlocks_.append(OpenBlock{container, container->indent(), container->depth()});
+}
+
+int Parser::threadCount() const {
+  return threadCount_;
+}
+
+void Parser::setThreadCount(int count) {
+  threadCount_ = count > 1 ? count : 1;
 }
   
 QString Parser::getHTMLText(const QString& mdText) {
+  MemoryPhase memoryPhase{MemoryStats::BlockParsing};
+  LineIndex lines{mdText};
+
+  if (threadCount_ > 1 && lines.size() >= 2 * MIN_CHUNK_LINES) {
+    QVector<int> splitPoints{findSplitPoints(lines, threadCount_)};
+
+    if (splitPoints.size() > 2) return getHTMLTextInParallel(lines, splitPoints);
+  }
+
   BodyBlock root;
-  current_ = &root;
-  root.setParser(this);
-  linkList_.clear();
+  parseChunk(&root, lines, 0, lines.size());
+
+  MemoryStats::setPhase(MemoryStats::Rendering);
+
+  return root.html();
+}
+
+int Parser::lineNumber() const {
+  return lineNumber_;
+}
+
+// Renders the first top-level blocks of mdText, up to maxBlocks of them and
+// until the HTML reaches maxBytes of UTF-8, where 0 is no limit.  A block is
+// parsed, inline ones too, only before it is rendered, and the lines after the
+// last one are not parsed unless a link reference definition may be there.
+QString Parser::getExcerpt(const QString& mdText, int maxBlocks, int maxBytes) {
+  MemoryPhase memoryPhase{MemoryStats::BlockParsing};
+  LineIndex lines{mdText};
+  BodyBlock root;
+  beginDocument(&root);
+
+  // All link reference definitions are needed, so the lines are parsed at
+  // least until the block with the last possible one is closed
+  const int definitionLine{lines.lastDefinitionLine()};
+  int number{0};
+
+  while (number <= definitionLine) {
+    number = parseBlocks(&root, lines, number, root.childCount());
+  }
+
+  if (definitionLine >= 0) number = parseBlocks(&root, lines, number, root.childCount());
+
+  QString html{};
+  int bytes{0};
+  int count{0};
 
-  for (QStringRef line : mdText.splitRef('\n')) {
+  while ((maxBlocks <= 0 || count < maxBlocks) && (maxBytes <= 0 || bytes < maxBytes)) {
+    number = parseBlocks(&root, lines, number, count + 1);
 
-    LineHandler lineHandler{line};
+    if (count == root.childCount()) break;
 
-    if (!current()->dispatchBlankLine(lineHandler)) {
-      while (!current()->dispatchIndentedCode(lineHandler) &&
-	     !current()->dispatchLeafBlock(&lineHandler)) {
-	lineHandler.skipWhitespace();
+    MemoryStats::setPhase(MemoryStats::Rendering);
 
-	if (!current()->dispatchContainerBlock(&lineHandler)) {
-	  current()->dispatchHeadingAndParagraph(&lineHandler);
+    if (count > 0) html.append('\n');
 
-	  break;
-	}
+    QString block{root.children().at(count++)->html()};
+    bytes += utf8Size(block) + (count > 1 ? 1 : 0);
+    html.append(block);
+    MemoryStats::setPhase(MemoryStats::BlockParsing);
+  }
+
+  openBlocks_.clear();
+
+  return html;
+}
+
+// Returns the headings of mdText in order, for a table of contents.  The
+// inline text of no other block is parsed.
+QVector<OutlineItem> Parser::getOutline(const QString& mdText) {
+  MemoryPhase memoryPhase{MemoryStats::BlockParsing};
+  LineIndex lines{mdText};
+  BodyBlock root;
+  parseChunk(&root, lines, 0, lines.size());
+
+  MemoryStats::setPhase(MemoryStats::Rendering);
+  QVector<OutlineItem> outline{};
+  root.appendOutline(&outline);
+
+  return outline;
+}
+
+// Returns the text of mdText without markup, for indexing.  Code is kept as it
+// is, and HTML blocks are left out.
+QString Parser::getPlainText(const QString& mdText) {
+  MemoryPhase memoryPhase{MemoryStats::BlockParsing};
+  LineIndex lines{mdText};
+  BodyBlock root;
+  parseChunk(&root, lines, 0, lines.size());
+
+  MemoryStats::setPhase(MemoryStats::Rendering);
+  QString text{};
+  root.appendPlainText(&text);
+
+  return text;
+}
+
+void Parser::dispatchLine(const LineIndex& lines, int number) {
+  LineHandler lineHandler{lines, number};
+  lineNumber_ = number;
+
+  if (!current()->dispatchBlankLine(lineHandler)) {
+    while (!current()->dispatchIndentedCode(lineHandler) &&
+	   !current()->dispatchLeafBlock(&lineHandler)) {
+      lineHandler.skipWhitespace();
+
+      if (!current()->dispatchContainerBlock(&lineHandler)) {
+	current()->dispatchHeadingAndParagraph(&lineHandler);
+
+	break;
       }
     }
   }
-  
+}
+
+// Parses lines [begin, end) into root, as continueChunk()
+bool Parser::parseChunk(BodyBlock* root, const LineIndex& lines, int begin, int end) {
+  MemoryPhase memoryPhase{MemoryStats::BlockParsing};
+  beginDocument(root);
+
+  return continueChunk(root, lines, begin, end);
+}
+
+// Dispatches lines [begin, end) into root.  If lines follow, the line at end is
+// dispatched too, so that it closes the blocks before it as in a sequential
+// parse.  If it starts a new top-level block, that block is removed again and
+// root is closed.  Otherwise, i.e. a list or another block runs over the chunk
+// boundary, root is left open after the line at end, and false is returned.
+bool Parser::continueChunk(BodyBlock* root, const LineIndex& lines, int begin, int end) {
+  MemoryPhase memoryPhase{MemoryStats::BlockParsing};
+
+  for (int i{begin}; i < end; ++i) {
+    dispatchLine(lines, i);
+  }
+
+  if (end < lines.size()) {
+    int count{root->children().size()};
+    dispatchLine(lines, end);
+
+    if (current() != root || root->children().size() != count + 1) return false;
+
+    Block* next{root->last()};
+    root->removeLast();
+    delete next;
+  }
+
+  endDocument(root);
+
+  return true;
+}
+
+// Dispatches lines from number until count top-level blocks are closed, which
+// is when another one follows them, closing all at the end of the document.
+// Returns the number of the next line.
+int Parser::parseBlocks(BodyBlock* root, const LineIndex& lines, int number, int count) {
+  while (number < lines.size() && root->childCount() <= count) {
+    dispatchLine(lines, number++);
+
+    if (number == lines.size()) endDocument(root);
+  }
+
+  return number;
+}
+
+// Starts parsing lines into root, one at a time with dispatchLine()
+void Parser::beginDocument(BodyBlock* root) {
+  root->setParser(this);
+  setCurrent(root);
+  linkList_.clear();
+}
+
+// Closes the blocks left open at the end of the document
+void Parser::endDocument(BodyBlock* root) {
   while (unwind()) {}
 
-  root.close();
+  root->close();
+}
 
-  return root.html();
+// Returns the first lines of at most count chunks of similar size, followed by
+// lines.size().  A chunk starts after a blank line outside fenced code, at a
+// line which cannot continue a list, a block quote or an HTML block.
+QVector<int> Parser::findSplitPoints(const LineIndex& lines, int count) {
+  int chunkLines{qMax(lines.size() / count, MIN_CHUNK_LINES)};
+  QVector<int> splitPoints{0};
+  QChar fence{};
+  int fenceLength{0};
+  bool afterBlankLine{false};
+
+  for (int i{0}; i < lines.size() && splitPoints.size() < count; ++i) {
+    const QStringRef line{lines.line(i)};
+
+    if (fenceLength == 0 && afterBlankLine &&
+	i - splitPoints.last() >= chunkLines && lines.size() - i >= MIN_CHUNK_LINES &&
+	isChunkStart(line)) {
+      splitPoints.append(i);
+    }
+
+    QChar c{};
+    int length{getFenceLength(line, &c)};
+
+    if (fenceLength == 0) {
+      fence = c;
+      fenceLength = length;
+    } else if (length >= fenceLength && c == fence &&
+	       isBlank(line.mid(line.indexOf(c) + length))) {
+      fenceLength = 0;
+    }
+
+    afterBlankLine = lines.isBlank(i);
+  }
+
+  splitPoints.append(lines.size());
+
+  return splitPoints;
+}
+
+// Parses the chunks between splitPoints concurrently, continues a chunk over
+// the next ones while a block runs over their boundary, merges the link reference
+// definitions in document order and renders the chunks concurrently.
+QString Parser::getHTMLTextInParallel(const LineIndex& lines, const QVector<int>& splitPoints) {
+  QVector<Chunk> chunks{};
+
+  for (int i{1}; i < splitPoints.size(); ++i) {
+    chunks.append(Chunk{splitPoints.at(i - 1), splitPoints.at(i), new Parser, new BodyBlock, false, QString()});
+  }
+
+  runInParallel(&chunks, [&lines](Chunk* chunk) {
+      chunk->resynchronized = chunk->parser->parseChunk(chunk->root, lines, chunk->begin, chunk->end);
+    });
+
+  // An open chunk is continued in one pass, so each line is parsed again once
+  // at most, and the chunks it takes over are dropped.
+  for (int i{0}; i < chunks.size() - 1; ++i) {
+    while (!chunks.at(i).resynchronized) {
+      Chunk next{chunks.at(i + 1)};
+      Chunk& chunk = chunks[i];
+      chunk.resynchronized = chunk.parser->continueChunk(chunk.root, lines, chunk.end + 1, next.end);
+      chunk.end = next.end;
+      delete next.root;
+      delete next.parser;
+      chunks.remove(i + 1);
+    }
+  }
+
+  linkList_.clear();
+
+  for (const Chunk& chunk : chunks) {
+    for (auto link{chunk.parser->linkList_.cbegin()}; link != chunk.parser->linkList_.cend(); ++link) {
+      if (!linkList_.contains(link.key())) linkList_.insert(link.key(), link.value());
+    }
+  }
+
+  for (Chunk& chunk : chunks) {
+    chunk.parser->linkList_ = linkList_;
+  }
+
+  runInParallel(&chunks, [](Chunk* chunk) {
+      MemoryPhase memoryPhase{MemoryStats::Rendering};
+      chunk->html = chunk->root->html();
+    });
+
+  MemoryStats::setPhase(MemoryStats::Rendering);
+  QStringList htmlText{};
+
+  for (const Chunk& chunk : chunks) {
+    if (!chunk.root->isEmpty()) htmlText.append(chunk.html);
+
+    delete chunk.root;
+    delete chunk.parser;
+  }
+
+  openBlocks_.clear();
+
+  return htmlText.join('\n');
 }
 
 bool Parser::unwind() {
-  ContainerBlock* parent = current()->parent();
-  
-  if (!parent) return false;
+  if (openBlocks_.size() < 2) return false;
 
-  current()->close();
-  current_ = parent;
+  closeAbove(openBlocks_.size() - 2);
 
   return true;
 }
 
+// Closes the current container, and then the ones deeper than depth
+ContainerBlock* Parser::unwindToDepth(int depth) {
+  int level{openBlocks_.size() - 1};
+
+  if (level > 0) --level;
+
+  while (level > 0 && openBlocks_.at(level).depth > depth) --level;
+
+  closeAbove(level);
+
+  return current();
+}
+
 bool Parser::unwindUntil(int indent) {
-  while (indent < current()->indent()) {
-    if (!unwind()) break;
-  }
+  int level{openBlocks_.size() - 1};
+
+  while (level > 0 && indent < openBlocks_.at(level).indent) --level;
+
+  closeAbove(level);
 
   return true;
 }
 
+void Parser::closeAbove(int level) {
+  while (openBlocks_.size() > level + 1) {
+    openBlocks_.last().block->close();
+    openBlocks_.removeLast();
+  }
+}
+
 void Parser::defineLink(const QString& label, const QString& reference, const QString& title) {
   QString lowercaseLabel{label.toLower()};
 
@@ -102,6 +472,22 @@ void Parser::defineLink(const QString& label, const QString& reference, const QS
   linkList_.insert(lowercaseLabel, qMakePair(reference, title));
 }
 
+bool Parser::hasLink(const QString& label) const {
+  return linkList_.contains(label.toLower());
+}
+
+// Sets the reference and the title of a defined link, as written in HTML
+bool Parser::findLink(const QString& label, QString* reference, QString* title) const {
+  auto link{linkList_.find(label.toLower())};
+
+  if (link == linkList_.end()) return false;
+
+  *reference = link->first;
+  *title = link->second;
+
+  return true;
+}
+
 QString Parser::getLinkText(const QString& label) const {
   QString lowercaseLabel{label.toLower()};
 
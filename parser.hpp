@@ -21,9 +21,11 @@
 
 #include <QMap>
 #include <QPair>
+#include <QVector>
 #include "containerblock.hpp"
 
 class ConainerBlock;
+class LineIndex;
 
 
 class Parser {
@@ -33,21 +35,50 @@ public:
   Parser& operator=(const Parser& other) = delete;
   ~Parser();
 
+  void beginDocument(BodyBlock* root);
   ContainerBlock* current();
   void defineLink(const QString& label, const QString& reference, const QString& title);
+  void dispatchLine(const LineIndex& lines, int number);
+  void endDocument(BodyBlock* root);
+  bool findLink(const QString& label, QString* reference, QString* title) const;
+  QString getExcerpt(const QString& mdText, int maxBlocks, int maxBytes);
   QString getImageText(const QString& label) const;
+  QVector<OutlineItem> getOutline(const QString& mdText);
   QString getImageText(const QString& label, const QString& description) const;
   QString getLinkText(const QString& label) const;
   QString getLinkText(const QString& label, const QString& text) const;
   QString getHTMLText(const QString& mdText);
+  QString getPlainText(const QString& mdText);
+  bool hasLink(const QString& label) const;
+  int lineNumber() const;
+  int parseBlocks(BodyBlock* root, const LineIndex& lines, int number, int count);
   void setCurrent(ContainerBlock* container);
+  void setThreadCount(int count);
+  int threadCount() const;
   bool unwind();
+  ContainerBlock* unwindToDepth(int depth);
   bool unwindUntil(int indent);
 
 
 private:
-  ContainerBlock* current_;
+  // An open container, with the values unwinding compares
+  struct OpenBlock {
+    ContainerBlock* block;
+    int indent;
+    int depth;
+  };
+
+  void closeAbove(int level);
+  bool continueChunk(BodyBlock* root, const LineIndex& lines, int begin, int end);
+  QString getHTMLTextInParallel(const LineIndex& lines, const QVector<int>& splitPoints);
+  bool parseChunk(BodyBlock* root, const LineIndex& lines, int begin, int end);
+
+  static QVector<int> findSplitPoints(const LineIndex& lines, int count);
+
+  QVector<OpenBlock> openBlocks_; // from the root to the current container
   QMap<QString, QPair<QString, QString> > linkList_;
+  int lineNumber_; // of the line being dispatched
+  int threadCount_;
 
 public:
   const QString inlineLinkTemplate1;
@@ -70,6 +70,10 @@ bool Precedence::isEmpty() const {
 bool Precedence::isIncomplete() const {
   return end_ < 0;
 }
+
+bool Precedence::isStrong() const {
+  return count_ > 1;
+}
  
 bool Precedence::isAheadOf(int pos) const {
   return pos > begin_;
@@ -42,6 +42,7 @@ public:
   bool isLeftFlankingDelimiterRun(int pos, int size);
   bool isRightFlankingDelimiterRun(int pos, int size);
   bool isSameDelimiterAs(QChar delimiter) const;
+  bool isStrong() const;
   int htmlLeftPart(QString* applied, int lastPos) const;
   int htmlRightPart(QString* applied, int lastPos) const;
   bool open(int* pos, Precedence* second);
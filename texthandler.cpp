@@ -23,6 +23,34 @@
 #include "character.hpp"
 
 
+namespace {
+  // ASCII characters written as they are in URLs: the unreserved ones and
+  // "@#%()*/:+=?,", which QByteArray::toPercentEncoding() would leave.  '&' is
+  // left too, but written as "&amp;".
+  const bool urlCharacterTable[128]{
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 1, 0, 1, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, //  !"#$%&'()*+,-./
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 0, 1, // 0123456789:;<=>?
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // @ABCDEFGHIJKLMNO
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1, // PQRSTUVWXYZ[\]^_
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // `abcdefghijklmno
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0, // pqrstuvwxyz{|}~
+  };
+
+  inline bool isURLCharacter(ushort chr) {
+    return chr < 128 && urlCharacterTable[chr];
+  }
+
+  void appendPercentEncodedByte(QString* output, uint byte) {
+    static const char hexDigits[]{"0123456789ABCDEF"};
+    const QChar encoded[]{ QLatin1Char('%'), QLatin1Char(hexDigits[byte >> 4]), QLatin1Char(hexDigits[byte & 0xf]) };
+
+    output->append(encoded, 3);
+  }
+}
+
+
 TextHandler::TextHandler(const QString& text) : text_(&text) {
 }
 
@@ -148,7 +176,7 @@ QString TextHandler::findLinkReference(int *begin) const {
     escape = EscapeChar::get(text_.mid(pos));
 
     if (!escape.isEmpty()) {
-      temp.append(escape.output());
+      escape.appendTo(&temp);
       pos += escape.inputLength();
     } else {
       temp.append(chr);
@@ -201,7 +229,7 @@ QString TextHandler::findLinkTitle(int* begin, bool* ok) const {
 	escape = EscapeChar::get(text_.mid(pos));
 
 	if (!escape.isEmpty()) {
-	  title.append(escape.output());
+	  escape.appendTo(&title);
 	  pos += escape.inputLength();
 	} else {
 	  title.append(chr2);
@@ -249,12 +277,54 @@ int TextHandler::skipWhitespace(int begin, bool* hasLinebreak) const {
   return pos;
 }
 
+// Returns the text percent-encoded, as a URL outside HTML
 QString TextHandler::convertToPercentEncoding() const {
-  static const QByteArray percentEncodingException{"@#%()&*/:+=?,"};
-  const char* amp{"&"};
-  const char* ampRef{"&amp;"};
+  QString output{};
+  appendPercentEncoded(&output, false);
 
-  return text_.toUtf8().toPercentEncoding(percentEncodingException).replace(amp, ampRef);
+  return output;
+}
+
+// Appends the text percent-encoded as UTF-8, with '&' as "&amp;" for HTML, in
+// one pass.  Runs of characters which are written as they are, are copied at
+// once.
+void TextHandler::appendPercentEncoded(QString* output, bool isHTML) const {
+  const QChar* text{text_.unicode()};
+  const int length{text_.length()};
+  int pos{0};
+
+  while (pos < length) {
+    int begin{pos};
+
+    while (pos < length && isURLCharacter(text[pos].unicode())) ++pos;
+
+    output->append(text + begin, pos - begin);
+
+    if (pos >= length) break;
+
+    QChar chr{text[pos++]};
+
+    if (chr == '&') {
+      output->append(isHTML ? QLatin1String("&amp;") : QLatin1String("&"));
+    } else if (chr.unicode() < 0x80) {
+      appendPercentEncodedByte(output, chr.unicode());
+    } else if (chr.unicode() < 0x800) {
+      appendPercentEncodedByte(output, 0xc0 | (chr.unicode() >> 6));
+      appendPercentEncodedByte(output, 0x80 | (chr.unicode() & 0x3f));
+    } else if (!chr.isSurrogate()) {
+      appendPercentEncodedByte(output, 0xe0 | (chr.unicode() >> 12));
+      appendPercentEncodedByte(output, 0x80 | ((chr.unicode() >> 6) & 0x3f));
+      appendPercentEncodedByte(output, 0x80 | (chr.unicode() & 0x3f));
+    } else if (chr.isHighSurrogate() && pos < length && text[pos].isLowSurrogate()) {
+      uint ucs4{QChar::surrogateToUcs4(chr, text[pos++])};
+      appendPercentEncodedByte(output, 0xf0 | (ucs4 >> 18));
+      appendPercentEncodedByte(output, 0x80 | ((ucs4 >> 12) & 0x3f));
+      appendPercentEncodedByte(output, 0x80 | ((ucs4 >> 6) & 0x3f));
+      appendPercentEncodedByte(output, 0x80 | (ucs4 & 0x3f));
+    } else {
+      output->append(QLatin1Char('?')); // as QString::toUtf8() writes a lone surrogate
+    }
+  }
 }
 
 QString TextHandler::convertEntityReferecence() const {
@@ -27,6 +27,7 @@ public:
   explicit TextHandler(const QString& text);
   explicit TextHandler(const QStringRef& text);
 
+  void appendPercentEncoded(QString* output, bool isHTML = true) const;
   bool isAutolink() const;
   QString convertEntityReferecence() const;
   QString convertToPercentEncoding() const;